@@ -43,6 +43,18 @@
 /* Connection module. Default standard. */
 #define ALTERNATE_CONNECTIONS 1
 
+/* Keep the board and reading state per thread, so that several threads
+   can play and read on boards of their own. Enabled by default where
+   POSIX threads are available. */
+#cmakedefine THREADED_BOARD 1
+
+/* Define to 1 if the compiler can build F16C code for CPUs detected
+   at run time. */
+#cmakedefine HAVE_F16C_TARGET 1
+
+/* Largest supported board size, 19 unless configured lower. */
+#cmakedefine MAX_BOARD ${MAX_BOARD}
+
 /* Define as 1 to use the grid optimisation, or 2 to run it in self-test mode
    */
 #define GRID_OPT 1
@@ -77,6 +89,15 @@
 /* Define to 1 if you have the <sys/types.h> header file. */
 #cmakedefine HAVE_SYS_TYPES_H 1
 
+/* Define to 1 if you have the <sys/mman.h> header file. */
+#cmakedefine HAVE_SYS_MMAN_H 1
+
+/* Define to 1 if you have the <dirent.h> header file. */
+#cmakedefine HAVE_DIRENT_H 1
+
+/* Define to 1 if POSIX threads are available. */
+#cmakedefine HAVE_PTHREAD 1
+
 /* Define to 1 if you have the <term.h> header file. */
 #cmakedefine HAVE_TERM_H 1
 
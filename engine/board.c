@@ -39,6 +39,10 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 
 /* This can be used for internal checks w/in board.c that should
  * typically not be necessary (for speed).
@@ -63,17 +67,17 @@ struct string_data {
                                    /* "upper left" stone. */
   int liberties;                   /* Number of liberties. */
   int neighbors;                   /* Number of neighbor strings */
+  int neighbor_list;               /* Index of the neighbor list in */
+                                   /* string_neighbors[]. */
+  int max_neighbors;               /* Room in the neighbor list. */
   int mark;                        /* General purpose mark. */
+  int lowlib;                      /* 1 + index in lowlib_strings[]. */
 };
 
 struct string_liberties_data {
   int list[MAX_LIBERTIES];         /* Coordinates of liberties. */
 };
 
-struct string_neighbors_data {
-  int list[MAXCHAIN];              /* List of neighbor string numbers. */
-};
-
 /* we keep the address and the old value */
 struct change_stack_entry {
   int *address;
@@ -95,6 +99,20 @@ struct vertex_stack_entry {
 #define STACK_SIZE 80 * MAXSTACK
 
 
+/* The neighbor lists of the strings are allocated from one array, in
+ * the same way as the string numbers: above stackp==0 a list which
+ * has to grow is moved to the end of the used space, and the space of
+ * moved lists and of the lists of removed or merged strings is only
+ * regained when the move is taken back. A move allocates at most one
+ * list for the played string and moves the lists of at most four
+ * neighbors, each at most MAXCHAIN long, so a trial move is refused
+ * unless that much space is left. In practice a move needs some five
+ * entries, also in random playouts down to nearly MAXSTACK.
+ */
+#define NEIGHBOR_POOL_SIZE (32 * MAXSTACK)
+#define MAX_NEIGHBORS_PER_MOVE (5 * MAXCHAIN)
+
+
 #define CLEAR_STACKS() do { \
   change_stack_pointer = change_stack; \
   vertex_stack_pointer = vertex_stack; \
@@ -135,28 +153,41 @@ struct vertex_stack_entry {
 
 
 /* Main array of string information. */
-static struct string_data string[MAX_STRINGS];
-static struct string_liberties_data string_libs[MAX_STRINGS];
-static struct string_neighbors_data string_neighbors[MAX_STRINGS];
+static BOARD_LOCAL struct string_data string[MAX_STRINGS];
+static BOARD_LOCAL struct string_liberties_data string_libs[MAX_STRINGS];
+static BOARD_LOCAL int string_neighbors[NEIGHBOR_POOL_SIZE];
+
+/* Lists of the strings of each color with at most two liberties. A
+ * string is added when it is created or its liberties drop to two, and
+ * stays until that is undone through the change stack, so during
+ * reading the lists may also hold strings which have been captured,
+ * merged or have gained liberties since. Such entries are skipped by
+ * find_lowlib_strings() and cleaned out after each permanent move.
+ * Removing them at once costs more pushes than it saves in the
+ * queries: trymove() becomes about 15% slower and ladder_features(),
+ * which spends most of its time in trymove(), gains nothing.
+ */
+static BOARD_LOCAL int lowlib_strings[3][MAX_STRINGS];
+static BOARD_LOCAL int lowlib_count[3];
 
 /* Stacks and stack pointers. */
-static struct change_stack_entry change_stack[STACK_SIZE];
-static struct change_stack_entry *change_stack_pointer;
+static BOARD_LOCAL struct change_stack_entry change_stack[STACK_SIZE];
+static BOARD_LOCAL struct change_stack_entry *change_stack_pointer;
 
-static struct vertex_stack_entry vertex_stack[STACK_SIZE];
-static struct vertex_stack_entry *vertex_stack_pointer;
+static BOARD_LOCAL struct vertex_stack_entry vertex_stack[STACK_SIZE];
+static BOARD_LOCAL struct vertex_stack_entry *vertex_stack_pointer;
 
 
 /* Index into list of strings. The index is only valid if there is a
  * stone at the vertex.
  */
-static int string_number[BOARDMAX];
+static BOARD_LOCAL int string_number[BOARDMAX];
 
 
 /* The stones in a string are linked together in a cyclic list. 
  * These are the coordinates to the next stone in the string.
  */
-static int next_stone[BOARDMAX];
+static BOARD_LOCAL int next_stone[BOARDMAX];
 
 
 /* ---------------------------------------------------------------- */
@@ -268,8 +299,16 @@ static int next_stone[BOARDMAX];
     ml[pos] = liberty_mark;\
   } while (0)
 
-#define ADD_NEIGHBOR(s, pos)\
-  string_neighbors[s].list[string[s].neighbors++] = string_number[pos]
+#define NEIGHBORS(s) (string_neighbors + string[s].neighbor_list)
+
+#define ADD_NEIGHBOR_STRING(s, t)\
+  do {\
+    if (string[s].neighbors == string[s].max_neighbors)\
+      grow_neighbor_list(s);\
+    NEIGHBORS(s)[string[s].neighbors++] = (t);\
+  } while (0)
+
+#define ADD_NEIGHBOR(s, pos) ADD_NEIGHBOR_STRING(s, string_number[pos])
 
 #define DO_ADD_STONE(pos, color)\
   do {\
@@ -291,13 +330,63 @@ static int next_stone[BOARDMAX];
 
 
 /* Number of the next free string. */
-static int next_string;
+static BOARD_LOCAL int next_string;
+
+/* Index of the first free entry in string_neighbors[]. */
+static BOARD_LOCAL int next_neighbor;
 
 
 /* For marking purposes. */
-static int ml[BOARDMAX];
-static int liberty_mark;
-static int string_mark;
+static BOARD_LOCAL int ml[BOARDMAX];
+static BOARD_LOCAL int liberty_mark;
+static BOARD_LOCAL int string_mark;
+
+
+/* Undo information for a permanent move: the state before the move
+ * and the index of its first board change in the undo journal.
+ */
+struct undo_record {
+  int first_change;
+  int ko_pos;
+  int white_captured;
+  int black_captured;
+};
+
+/* A board change in the undo journal, with the old value of the vertex. */
+struct undo_change {
+  int pos;
+  Intersection value;
+};
+
+/* Every move places at most one stone, and every stone can be removed
+ * at most once after it was placed by a move or on the initial board.
+ */
+#define MAX_UNDO_CHANGES (2 * MAX_MOVE_HISTORY + MAX_BOARD * MAX_BOARD)
+
+/* Undo journal of the permanent moves in the move history. The board
+ * changes of each move are stored in undo_changes[], so that undo_move()
+ * can restore them without replaying the game.
+ */
+static BOARD_LOCAL struct undo_record move_history_undo[MAX_MOVE_HISTORY];
+static BOARD_LOCAL struct undo_change undo_changes[MAX_UNDO_CHANGES];
+static BOARD_LOCAL int undo_change_pointer;
+
+
+/* Hash set of the positions in the move history, for the superko test.
+ * It uses open addressing with linear probing. Each slot counts how
+ * often its position occurred with each color to move. Slots are never
+ * emptied, so the set is rebuilt from the history when it fills up.
+ */
+#define SUPERKO_SET_SIZE 1024   /* More than twice MAX_MOVE_HISTORY. */
+
+struct superko_entry {
+  Hash_data hash;
+  int used;
+  int to_move[3];            /* Indexed by WHITE and BLACK. */
+};
+
+static BOARD_LOCAL struct superko_entry superko_set[SUPERKO_SET_SIZE];
+static BOARD_LOCAL int superko_set_used;
 
 
 /* Forward declarations. */
@@ -310,19 +399,25 @@ static int slow_approxlib(int pos, int color, int maxlib, int *libs);
 static int do_accuratelib(int pos, int color, int maxlib, int *libs);
 
 static int is_superko_violation(int pos, int color, enum ko_rules type);
+static void hash_after_move(int pos, int color, Hash_data *hash);
+static void hash_remove_string(int str, Hash_data *hash);
+static void superko_set_rebuild(void);
 
 static void new_position(void);
 static int propagate_string(int stone, int str);
 static void find_liberties_and_neighbors(int s);
+static void grow_neighbor_list(int s);
 static int do_remove_string(int s);
+static void update_lowlib(int s);
+static void clean_lowlib_lists(void);
 static void do_commit_suicide(int pos, int color);
 static void do_play_move(int pos, int color);
 
-static int komaster, kom_pos;
+static BOARD_LOCAL int komaster, kom_pos;
 
 
 /* Statistics. */
-static int trymove_counter = 0;
+static BOARD_LOCAL int trymove_counter = 0;
 
 /* Coordinates for the eight directions, ordered
  * south, west, north, east, southwest, northwest, northeast, southeast.
@@ -333,86 +428,343 @@ int delta[8]  = { NS, -1, -NS, 1, NS-1, -NS-1, -NS+1, NS+1};
 
 
 /* ================================================================ */
-/*                    Board initialization                          */
+/*                        Board snapshots                           */
 /* ================================================================ */
 
-/*
- * Save board state.
+/* The move history of snapshots is kept in reference counted blocks,
+ * which never change once written. A block holds the moves from
+ * first_move to num_moves with their part of the undo journal, and
+ * refers to its parent for the earlier moves. Snapshots taken while
+ * the game goes on thus share the history they have in common, and
+ * snapshots of the same position share all of it.
  */
+struct history_block {
+  int refcount;
+  struct history_block *parent;
+  int first_move;
+  int num_moves;
+  int first_change;
+  int num_changes;
+  Hash_data *hash;
+  struct undo_record *undo;
+  struct undo_change *changes;
+  int *color;
+  int *pos;
+};
 
-void
-store_board(struct board_state *state)
-{
-  int k;
+/* A snapshot also carries the incremental string data, so that it can
+ * be restored without rebuilding the strings. Of the neighbor lists
+ * only the used part is kept.
+ */
+struct board_snapshot {
+  int board_size;
+  Intersection board[BOARDSIZE];
+  int board_ko_pos;
+  int white_captured;
+  int black_captured;
+  Hash_data board_hash;
+
+  Intersection initial_board[BOARDSIZE];
+  int initial_board_ko_pos;
+  int initial_white_captured;
+  int initial_black_captured;
+  int move_history_pointer;
+  int undo_change_pointer;
+  struct history_block *history;
+
+  float komi;
+  int handicap;
+  int move_number;
+
+  int next_string;
+  int next_neighbor;
+  int liberty_mark;
+  int string_mark;
+  int string_number[BOARDMAX];
+  int next_stone[BOARDMAX];
+  int lowlib_strings[3][MAX_BOARD * MAX_BOARD];
+  int lowlib_count[3];
+  struct string_data *strings;
+  struct string_liberties_data *string_libs;
+  int *neighbors;
+};
 
-  gg_assert(stackp == 0);
+/* The block holding the current move history, if there is one. */
+static BOARD_LOCAL struct history_block *current_history;
 
-  state->board_size = board_size;
+#if HAVE_PTHREAD
+/* History blocks may be shared between threads. */
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
-  memcpy(state->board, board, sizeof(board));
-  memcpy(state->initial_board, initial_board, sizeof(initial_board));
+static void
+hold_history_block(struct history_block *block)
+{
+  if (!block)
+    return;
+#if HAVE_PTHREAD
+  pthread_mutex_lock(&history_lock);
+#endif
+  block->refcount++;
+#if HAVE_PTHREAD
+  pthread_mutex_unlock(&history_lock);
+#endif
+}
 
-  state->board_ko_pos = board_ko_pos;
-  state->white_captured = white_captured;
-  state->black_captured = black_captured;
-  
-  state->initial_board_ko_pos = initial_board_ko_pos;
-  state->initial_white_captured = initial_white_captured;
-  state->initial_black_captured = initial_black_captured;
-  
-  state->move_history_pointer = move_history_pointer;
-  for (k = 0; k < move_history_pointer; k++) {
-    state->move_history_color[k] = move_history_color[k];
-    state->move_history_pos[k] = move_history_pos[k];
-    state->move_history_hash[k] = move_history_hash[k];
+static void
+release_history_block(struct history_block *block)
+{
+#if HAVE_PTHREAD
+  pthread_mutex_lock(&history_lock);
+#endif
+  while (block && --block->refcount == 0) {
+    struct history_block *parent = block->parent;
+    free(block);
+    block = parent;
   }
+#if HAVE_PTHREAD
+  pthread_mutex_unlock(&history_lock);
+#endif
+}
+
+/* Forget the history block when earlier moves of the move history
+ * change.
+ */
+static void
+drop_current_history(void)
+{
+  release_history_block(current_history);
+  current_history = NULL;
+}
 
-  state->komi = komi;
-  state->handicap = handicap;
-  state->move_number = movenum;
+/* Return a history block for the current move history, writing a new
+ * block for the moves since the last one if necessary.
+ */
+static struct history_block *
+get_current_history(void)
+{
+  struct history_block *block;
+  int first_move = 0;
+  int first_change = 0;
+  int moves;
+  int changes;
+  char *data;
+
+  if (current_history) {
+    if (current_history->num_moves == move_history_pointer)
+      return current_history;
+    first_move = current_history->num_moves;
+    first_change = current_history->num_changes;
+  }
+
+  moves = move_history_pointer - first_move;
+  changes = undo_change_pointer - first_change;
+  block = malloc(sizeof(*block)
+		 + moves * (sizeof(Hash_data) + sizeof(struct undo_record)
+			    + 2 * sizeof(int))
+		 + changes * sizeof(struct undo_change));
+  if (block == NULL) {
+    perror("Couldn't allocate memory for board snapshot. \n");
+    exit(1);
+  }
+
+  /* The new block takes over the reference to its parent. */
+  block->refcount = 1;
+  block->parent = current_history;
+  block->first_move = first_move;
+  block->num_moves = move_history_pointer;
+  block->first_change = first_change;
+  block->num_changes = undo_change_pointer;
+
+  data = (char *) (block + 1);
+  block->hash = (Hash_data *) data;
+  data += moves * sizeof(Hash_data);
+  block->undo = (struct undo_record *) data;
+  data += moves * sizeof(struct undo_record);
+  block->changes = (struct undo_change *) data;
+  data += changes * sizeof(struct undo_change);
+  block->color = (int *) data;
+  data += moves * sizeof(int);
+  block->pos = (int *) data;
+
+  memcpy(block->hash, move_history_hash + first_move,
+	 moves * sizeof(Hash_data));
+  memcpy(block->undo, move_history_undo + first_move,
+	 moves * sizeof(struct undo_record));
+  memcpy(block->changes, undo_changes + first_change,
+	 changes * sizeof(struct undo_change));
+  memcpy(block->color, move_history_color + first_move, moves * sizeof(int));
+  memcpy(block->pos, move_history_pos + first_move, moves * sizeof(int));
+
+  current_history = block;
+  return block;
 }
 
 
-/*
- * Restore a saved board state.
+/* Take a snapshot of the board state. The snapshot can be restored any
+ * number of times, also by other threads, until it is freed with
+ * free_board_snapshot().
  */
+struct board_snapshot *
+take_board_snapshot(void)
+{
+  struct board_snapshot *snapshot;
+  int color;
+
+  gg_assert(stackp == 0);
 
+  snapshot = malloc(sizeof(*snapshot));
+  if (snapshot == NULL) {
+    perror("Couldn't allocate memory for board snapshot. \n");
+    exit(1);
+  }
+
+  snapshot->board_size = board_size;
+  memcpy(snapshot->board, board, sizeof(board));
+  snapshot->board_ko_pos = board_ko_pos;
+  snapshot->white_captured = white_captured;
+  snapshot->black_captured = black_captured;
+  snapshot->board_hash = board_hash;
+
+  memcpy(snapshot->initial_board, initial_board, sizeof(initial_board));
+  snapshot->initial_board_ko_pos = initial_board_ko_pos;
+  snapshot->initial_white_captured = initial_white_captured;
+  snapshot->initial_black_captured = initial_black_captured;
+  snapshot->move_history_pointer = move_history_pointer;
+  snapshot->undo_change_pointer = undo_change_pointer;
+  snapshot->history = NULL;
+  if (move_history_pointer > 0) {
+    snapshot->history = get_current_history();
+    hold_history_block(snapshot->history);
+  }
+
+  snapshot->komi = komi;
+  snapshot->handicap = handicap;
+  snapshot->move_number = movenum;
+
+  snapshot->next_string = next_string;
+  snapshot->next_neighbor = next_neighbor;
+  snapshot->liberty_mark = liberty_mark;
+  snapshot->string_mark = string_mark;
+  memcpy(snapshot->string_number, string_number, sizeof(string_number));
+  memcpy(snapshot->next_stone, next_stone, sizeof(next_stone));
+  for (color = WHITE; color <= BLACK; color++) {
+    gg_assert(lowlib_count[color] <= MAX_BOARD * MAX_BOARD);
+    snapshot->lowlib_count[color] = lowlib_count[color];
+    memcpy(snapshot->lowlib_strings[color], lowlib_strings[color],
+	   lowlib_count[color] * sizeof(int));
+  }
+
+  snapshot->strings = malloc(next_string * sizeof(string[0]));
+  snapshot->string_libs = malloc(next_string * sizeof(string_libs[0]));
+  snapshot->neighbors = malloc(next_neighbor * sizeof(int));
+  if ((next_string > 0
+       && (snapshot->strings == NULL || snapshot->string_libs == NULL))
+      || (next_neighbor > 0 && snapshot->neighbors == NULL)) {
+    perror("Couldn't allocate memory for board snapshot. \n");
+    exit(1);
+  }
+
+  memcpy(snapshot->strings, string, next_string * sizeof(string[0]));
+  memcpy(snapshot->string_libs, string_libs,
+	 next_string * sizeof(string_libs[0]));
+  memcpy(snapshot->neighbors, string_neighbors, next_neighbor * sizeof(int));
+
+  return snapshot;
+}
+
+
+/* Restore a board snapshot. Nothing is recomputed except the superko
+ * set, and the move history is shared with the snapshot until it is
+ * changed.
+ */
 void
-restore_board(struct board_state *state)
+restore_board_snapshot(const struct board_snapshot *snapshot)
 {
-  int k;
+  struct history_block *block;
+  int color;
 
   gg_assert(stackp == 0);
 
-  board_size = state->board_size;
+  board_size = snapshot->board_size;
+  memcpy(board, snapshot->board, sizeof(board));
+  board_ko_pos = snapshot->board_ko_pos;
+  white_captured = snapshot->white_captured;
+  black_captured = snapshot->black_captured;
+  board_hash = snapshot->board_hash;
+
+  memcpy(initial_board, snapshot->initial_board, sizeof(initial_board));
+  initial_board_ko_pos = snapshot->initial_board_ko_pos;
+  initial_white_captured = snapshot->initial_white_captured;
+  initial_black_captured = snapshot->initial_black_captured;
+
+  for (block = snapshot->history; block; block = block->parent) {
+    int moves = block->num_moves - block->first_move;
+    memcpy(move_history_hash + block->first_move, block->hash,
+	   moves * sizeof(Hash_data));
+    memcpy(move_history_undo + block->first_move, block->undo,
+	   moves * sizeof(struct undo_record));
+    memcpy(undo_changes + block->first_change, block->changes,
+	   (block->num_changes - block->first_change)
+	   * sizeof(struct undo_change));
+    memcpy(move_history_color + block->first_move, block->color,
+	   moves * sizeof(int));
+    memcpy(move_history_pos + block->first_move, block->pos,
+	   moves * sizeof(int));
+  }
+  move_history_pointer = snapshot->move_history_pointer;
+  undo_change_pointer = snapshot->undo_change_pointer;
+  hold_history_block(snapshot->history);
+  release_history_block(current_history);
+  current_history = snapshot->history;
+  superko_set_rebuild();
+
+  komi = snapshot->komi;
+  handicap = snapshot->handicap;
+  movenum = snapshot->move_number;
+
+  /* Marks left in ml[] and in the strings must stay below the current
+   * ones, so the marks never go back.
+   */
+  next_string = snapshot->next_string;
+  next_neighbor = snapshot->next_neighbor;
+  liberty_mark = gg_max(liberty_mark, snapshot->liberty_mark);
+  string_mark = gg_max(string_mark, snapshot->string_mark);
+  memcpy(string_number, snapshot->string_number, sizeof(string_number));
+  memcpy(next_stone, snapshot->next_stone, sizeof(next_stone));
+  for (color = WHITE; color <= BLACK; color++) {
+    lowlib_count[color] = snapshot->lowlib_count[color];
+    memcpy(lowlib_strings[color], snapshot->lowlib_strings[color],
+	   lowlib_count[color] * sizeof(int));
+  }
+  memcpy(string, snapshot->strings, next_string * sizeof(string[0]));
+  memcpy(string_libs, snapshot->string_libs,
+	 next_string * sizeof(string_libs[0]));
+  memcpy(string_neighbors, snapshot->neighbors, next_neighbor * sizeof(int));
 
-  memcpy(board, state->board, sizeof(board));
-  memcpy(initial_board, state->initial_board, sizeof(initial_board));
+  komaster = EMPTY;
+  kom_pos = NO_MOVE;
+  position_number++;
+  CLEAR_STACKS();
+}
 
-  board_ko_pos = state->board_ko_pos;
-  white_captured = state->white_captured;
-  black_captured = state->black_captured;
-  
-  initial_board_ko_pos = state->initial_board_ko_pos;
-  initial_white_captured = state->initial_white_captured;
-  initial_black_captured = state->initial_black_captured;
-  
-  move_history_pointer = state->move_history_pointer;
-  for (k = 0; k < move_history_pointer; k++) {
-    move_history_color[k] = state->move_history_color[k];
-    move_history_pos[k] = state->move_history_pos[k];
-    move_history_hash[k] = state->move_history_hash[k];
-  }
 
-  komi = state->komi;
-  handicap = state->handicap;
-  movenum = state->move_number;
-  
-  hashdata_recalc(&board_hash, board, board_ko_pos);
-  new_position();
+/* Free a board snapshot. */
+void
+free_board_snapshot(struct board_snapshot *snapshot)
+{
+  release_history_block(snapshot->history);
+  free(snapshot->strings);
+  free(snapshot->string_libs);
+  free(snapshot->neighbors);
+  free(snapshot);
 }
 
 
+/* ================================================================ */
+/*                    Board initialization                          */
+/* ================================================================ */
+
 /*
  * Clear the internal board.
  */
@@ -445,6 +797,9 @@ clear_board(void)
   initial_black_captured = 0;
 
   move_history_pointer = 0;
+  undo_change_pointer = 0;
+  drop_current_history();
+  superko_set_rebuild();
   movenum = 0;
 
   handicap = 0;
@@ -479,10 +834,10 @@ test_gray_border(void)
  * position and which color made them. Perhaps 
  * this should be one array of a structure 
  */
-static int stack[MAXSTACK];
-static int move_color[MAXSTACK];
+static BOARD_LOCAL int stack[MAXSTACK];
+static BOARD_LOCAL int move_color[MAXSTACK];
 
-static Hash_data board_hash_stack[MAXSTACK];
+static BOARD_LOCAL Hash_data board_hash_stack[MAXSTACK];
 
 /*
  * trymove pushes the position onto the stack, and makes a move
@@ -681,7 +1036,8 @@ do_trymove(int pos, int color, int ignore_ko)
   }
   
   /* Check for stack overflow. */
-  if (stackp >= MAXSTACK-2) {
+  if (stackp >= MAXSTACK-2
+      || next_neighbor > NEIGHBOR_POOL_SIZE - MAX_NEIGHBORS_PER_MOVE) {
     fprintf(stderr, 
 	    "gnugo: Truncating search. This is beyond my reading ability!\n");
     /* FIXME: Perhaps it's best to just assert here and be done with it? */
@@ -818,6 +1174,72 @@ reset_move_history(void)
   initial_white_captured = white_captured;
   initial_black_captured = black_captured;
   move_history_pointer = 0;
+  undo_change_pointer = 0;
+  drop_current_history();
+  superko_set_rebuild();
+}
+
+
+/* Find the slot of hash in the superko set, or the empty slot where it
+ * would go.
+ */
+static struct superko_entry *
+superko_set_find(Hash_data *hash)
+{
+  int k = hash->hashval[0] & (SUPERKO_SET_SIZE - 1);
+
+  while (superko_set[k].used
+	 && !hashdata_is_equal(superko_set[k].hash, *hash))
+    k = (k + 1) & (SUPERKO_SET_SIZE - 1);
+
+  return &superko_set[k];
+}
+
+/* Add the position before move k of the move history to the superko set. */
+static void
+superko_set_add(int k)
+{
+  struct superko_entry *entry;
+
+  /* Keep the set at most half full, so that probing stays short. The
+   * history holds fewer positions than that, so after a rebuild of the
+   * earlier moves there is room again.
+   */
+  if (superko_set_used >= SUPERKO_SET_SIZE / 2) {
+    gg_assert(k == move_history_pointer);
+    superko_set_rebuild();
+  }
+
+  entry = superko_set_find(&move_history_hash[k]);
+  if (!entry->used) {
+    entry->hash = move_history_hash[k];
+    entry->used = 1;
+    entry->to_move[WHITE] = 0;
+    entry->to_move[BLACK] = 0;
+    superko_set_used++;
+  }
+  entry->to_move[move_history_color[k]]++;
+}
+
+/* Remove the position before move k of the move history again. */
+static void
+superko_set_remove(int k)
+{
+  struct superko_entry *entry = superko_set_find(&move_history_hash[k]);
+  gg_assert(entry->used && entry->to_move[move_history_color[k]] > 0);
+  entry->to_move[move_history_color[k]]--;
+}
+
+/* Fill the superko set from scratch with the current move history. */
+static void
+superko_set_rebuild(void)
+{
+  int k;
+
+  memset(superko_set, 0, sizeof(superko_set));
+  superko_set_used = 0;
+  for (k = 0; k < move_history_pointer; k++)
+    superko_set_add(k);
 }
 
 /* Place a stone on the board and update the board_hash. This operation
@@ -856,16 +1278,25 @@ remove_stone(int pos)
 }
 
 
+/* Permanent moves update the strings incrementally, just like
+ * trymove(). The string data is only rebuilt by new_position() when
+ * half of the string numbers have been used up, so that the other half
+ * remains for reading, or when the marks have grown large.
+ */
+#define NEED_NEW_POSITION() \
+  (next_string >= MAX_STRINGS / 2 \
+   || next_neighbor >= NEIGHBOR_POOL_SIZE / 2 \
+   || liberty_mark > INT_MAX / 2 || string_mark > INT_MAX / 2)
+
 /* Play a move. Basically the same as play_move() below, but doesn't store
- * the move in history list.
- *
- * Set `update_internals' to zero if you want to play several moves in a
- * row to avoid overhead caused by new_position(). Don't forget to call
- * it yourself after all the moves have been played.
+ * the move in history list. The board changes are appended to the undo
+ * journal.
  */
 static void
-play_move_no_history(int pos, int color, int update_internals)
+play_move_no_history(int pos, int color)
 {
+  struct vertex_stack_entry *change;
+
 #if CHECK_HASHING
   Hash_data oldkey;
 
@@ -889,6 +1320,15 @@ play_move_no_history(int pos, int color, int update_internals)
     else
       do_commit_suicide(pos, color);
 
+    /* The vertex stack holds exactly the board changes of the move. */
+    gg_assert(undo_change_pointer + (vertex_stack_pointer - vertex_stack)
+	      <= MAX_UNDO_CHANGES);
+    for (change = vertex_stack; change < vertex_stack_pointer; change++) {
+      undo_changes[undo_change_pointer].pos = change->address - board;
+      undo_changes[undo_change_pointer].value = change->value;
+      undo_change_pointer++;
+    }
+
 #if CHECK_HASHING
     /* Check the hash table to see if it equals the previous one. */
     hashdata_recalc(&oldkey, board, board_ko_pos);
@@ -896,28 +1336,13 @@ play_move_no_history(int pos, int color, int update_internals)
 #endif
   }
 
-  if (update_internals || next_string == MAX_STRINGS)
+  if (NEED_NEW_POSITION())
     new_position();
-  else
+  else {
+    position_number++;
+    clean_lowlib_lists();
     CLEAR_STACKS();
-}
-
-/* Load the initial position and replay the first n moves. */
-static void
-replay_move_history(int n)
-{
-  int k;
-  
-  memcpy(board, initial_board, sizeof(board));
-  board_ko_pos = initial_board_ko_pos;
-  white_captured = initial_white_captured;
-  black_captured = initial_black_captured;
-  new_position();
-
-  for (k = 0; k < n; k++)
-    play_move_no_history(move_history_pos[k], move_history_color[k], 0);
-
-  new_position();
+  }
 }
 
 /* Play a move. If you want to test for legality you should first call
@@ -945,35 +1370,45 @@ play_move(int pos, int color)
 
   if (move_history_pointer >= MAX_MOVE_HISTORY) {
     /* The move history is full. We resolve this by collapsing the
-     * first about 10% of the moves into the initial position.
+     * first about 10% of the moves into the initial position. Their
+     * board changes are taken from the undo journal. A stone is placed
+     * where the vertex was empty before and removed elsewhere.
      */
     int number_collapsed_moves = 1 + MAX_MOVE_HISTORY / 10;
+    struct undo_record *first_kept = &move_history_undo[number_collapsed_moves];
+    int number_collapsed_changes = first_kept->first_change;
     int k;
-    Intersection saved_board[BOARDSIZE];
-    int saved_board_ko_pos = board_ko_pos;
-    int saved_white_captured = white_captured;
-    int saved_black_captured = black_captured;
-    memcpy(saved_board, board, sizeof(board));
-
-    replay_move_history(number_collapsed_moves);
+    int m = 0;
+
+    for (k = 0; k < number_collapsed_changes; k++) {
+      struct undo_change *change = &undo_changes[k];
+      while (move_history_undo[m + 1].first_change <= k)
+	m++;
+      if (change->value == EMPTY)
+	initial_board[change->pos] = move_history_color[m];
+      else
+	initial_board[change->pos] = EMPTY;
+    }
 
-    memcpy(initial_board, board, sizeof(board));
-    initial_board_ko_pos = board_ko_pos;
-    initial_white_captured = white_captured;
-    initial_black_captured = black_captured;
+    initial_board_ko_pos = first_kept->ko_pos;
+    initial_white_captured = first_kept->white_captured;
+    initial_black_captured = first_kept->black_captured;
 
     for (k = number_collapsed_moves; k < move_history_pointer; k++) {
       move_history_color[k - number_collapsed_moves] = move_history_color[k];
       move_history_pos[k - number_collapsed_moves] = move_history_pos[k];
       move_history_hash[k - number_collapsed_moves] = move_history_hash[k];
+      move_history_undo[k - number_collapsed_moves] = move_history_undo[k];
+      move_history_undo[k - number_collapsed_moves].first_change
+	-= number_collapsed_changes;
     }
     move_history_pointer -= number_collapsed_moves;
 
-    memcpy(board, saved_board, sizeof(board));
-    board_ko_pos = saved_board_ko_pos;
-    white_captured = saved_white_captured;
-    black_captured = saved_black_captured;
-    new_position();
+    for (k = number_collapsed_changes; k < undo_change_pointer; k++)
+      undo_changes[k - number_collapsed_changes] = undo_changes[k];
+    undo_change_pointer -= number_collapsed_changes;
+    drop_current_history();
+    superko_set_rebuild();
   }
 
   move_history_color[move_history_pointer] = color;
@@ -981,9 +1416,14 @@ play_move(int pos, int color)
   move_history_hash[move_history_pointer] = board_hash;
   if (board_ko_pos != NO_MOVE)
     hashdata_invert_ko(&move_history_hash[move_history_pointer], board_ko_pos);
+  move_history_undo[move_history_pointer].first_change = undo_change_pointer;
+  move_history_undo[move_history_pointer].ko_pos = board_ko_pos;
+  move_history_undo[move_history_pointer].white_captured = white_captured;
+  move_history_undo[move_history_pointer].black_captured = black_captured;
+  superko_set_add(move_history_pointer);
   move_history_pointer++;
   
-  play_move_no_history(pos, color, 1);
+  play_move_no_history(pos, color);
   
   movenum++;
 }
@@ -991,6 +1431,9 @@ play_move(int pos, int color)
 
 /* Undo n permanent moves. Returns 1 if successful and 0 if it fails.
  * If n moves cannot be undone, no move is undone.
+ *
+ * The board changes of the moves are restored from the undo journal,
+ * so only the strings have to be rebuilt, no matter how long the game.
  */
 int
 undo_move(int n)
@@ -1001,9 +1444,33 @@ undo_move(int n)
   if (move_history_pointer < n)
     return 0;
 
-  replay_move_history(move_history_pointer - n);
-  move_history_pointer -= n;
-  movenum -= n;
+  while (n > 0) {
+    struct undo_record *undo = &move_history_undo[--move_history_pointer];
+    superko_set_remove(move_history_pointer);
+    while (undo_change_pointer > undo->first_change) {
+      struct undo_change *change = &undo_changes[--undo_change_pointer];
+      board[change->pos] = change->value;
+    }
+    board_ko_pos = undo->ko_pos;
+    white_captured = undo->white_captured;
+    black_captured = undo->black_captured;
+    board_hash = move_history_hash[move_history_pointer];
+    if (board_ko_pos != NO_MOVE)
+      hashdata_invert_ko(&board_hash, board_ko_pos);
+    movenum--;
+    n--;
+  }
+
+  /* Only keep the history blocks of the moves that are left. */
+  while (current_history
+	 && current_history->num_moves > move_history_pointer) {
+    struct history_block *parent = current_history->parent;
+    hold_history_block(parent);
+    release_history_block(current_history);
+    current_history = parent;
+  }
+
+  new_position();
 
   return 1;
 }
@@ -1104,7 +1571,8 @@ is_legal(int pos, int color)
   }
 
   /* Check for stack overflow. */
-  if (stackp >= MAXSTACK-2) {
+  if (stackp >= MAXSTACK-2
+      || next_neighbor > NEIGHBOR_POOL_SIZE - MAX_NEIGHBORS_PER_MOVE) {
     fprintf(stderr, 
 	    "gnugo: Truncating search. This is beyond my reading ability!\n");
     /* FIXME: Perhaps it's best to just assert here and be done with it? */
@@ -1238,6 +1706,116 @@ is_allowed_move(int pos, int color)
   return 1;
 }
 
+
+/*
+ * find_allowed_moves(color, allowed, exclude_own_eyes) marks the moves
+ * of color which are allowed according to is_allowed_move() with 1 in
+ * allowed[] and all other points with 0. With exclude_own_eyes the
+ * own eyes of color, see is_own_eye(), are left out too. Returns the
+ * number of allowed moves. Pass is not counted.
+ *
+ * Most moves are found from the string data without testing each
+ * point for suicide. Only points without an empty neighbor which are
+ * not listed as a liberty of a suitable string are tested, and only
+ * the superko rules need a test of every move.
+ *
+ * This function is only valid when stackp == 0.
+ */
+int
+find_allowed_moves(int color, signed char allowed[BOARDMAX],
+		   int exclude_own_eyes)
+{
+  int other = OTHER_COLOR(color);
+  int pos;
+  int s;
+  int k;
+  int moves = 0;
+
+  gg_assert(stackp == 0);
+
+  memset(allowed, 0, BOARDMAX);
+
+  /* 1. Liberties of own strings with two or more liberties, which the
+   *    move joins, and of opponent strings in atari, which it
+   *    captures, cannot be suicide. Only the first MAX_LIBERTIES
+   *    liberties of a string are listed.
+   */
+  for (s = 0; s < next_string; s++) {
+    int origin = string[s].origin;
+    int liberties = string[s].liberties;
+    if (string_number[origin] != s || board[origin] != string[s].color)
+      continue;
+    if ((string[s].color == color && liberties >= 2)
+	|| (string[s].color == other && liberties == 1))
+      for (k = 0; k < gg_min(liberties, MAX_LIBERTIES); k++)
+	allowed[string_libs[s].list[k]] = 1;
+  }
+
+  /* 2. Test the other empty points for suicide, see is_allowed_move(),
+   *    and apply the eye filter and the superko rules to all of them.
+   */
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
+    if (board[pos] != EMPTY)
+      continue;
+    if ((!allowed[pos]
+	 && is_suicide(pos, color)
+	 && (suicide_rule == FORBIDDEN
+	     || (suicide_rule == ALLOWED && !has_neighbor(pos, color))))
+	|| (exclude_own_eyes && is_own_eye(pos, color))
+	|| ((ko_rule == PSK || ko_rule == SSK)
+	    && is_superko_violation(pos, color, ko_rule))) {
+      allowed[pos] = 0;
+      continue;
+    }
+    allowed[pos] = 1;
+    moves++;
+  }
+
+  /* 3. Retaking a ko, as in is_allowed_move(). */
+  if (ko_rule != NONE
+      && board_ko_pos != NO_MOVE
+      && allowed[board_ko_pos]
+      && (board[WEST(board_ko_pos)] == other
+	  || board[EAST(board_ko_pos)] == other)) {
+    allowed[board_ko_pos] = 0;
+    moves--;
+  }
+
+  return moves;
+}
+
+
+/* An empty point counts as an eye of color if all its neighbors are
+ * stones of color and the opponent holds at most one diagonal point,
+ * or none on the edge. Playouts and move generation by search do not
+ * fill the players' own eyes.
+ */
+int
+is_own_eye(int pos, int color)
+{
+  int diagonal_enemies = 0;
+  int off_board = 0;
+  int k;
+
+  for (k = 0; k < 4; k++) {
+    int neighbor = pos + delta[k];
+    if (board[neighbor] != color && board[neighbor] != GRAY)
+      return 0;
+  }
+
+  for (k = 4; k < 8; k++) {
+    int diagonal = pos + delta[k];
+    if (!ON_BOARD(diagonal))
+      off_board++;
+    else if (board[diagonal] == OTHER_COLOR(color))
+      diagonal_enemies++;
+  }
+
+  if (off_board > 0)
+    return diagonal_enemies == 0;
+  return diagonal_enemies < 2;
+}
+
 /* Necessary work to set the new komaster state. */
 static void
 set_new_komaster(int new_komaster)
@@ -1522,6 +2100,33 @@ countlib(int str)
 }
 
 
+/* Find the strings of color with exactly liberties liberties, which
+ * must be 1 or 2, and write their origins into strings[]. The number
+ * of strings is returned. The candidates are kept in incrementally
+ * updated lists, so the time is proportional to the number found plus
+ * the strings changed by the moves on the stack.
+ */
+int
+find_lowlib_strings(int color, int liberties, int *strings)
+{
+  int k;
+  int n = 0;
+
+  ASSERT1(color == WHITE || color == BLACK, NO_MOVE);
+  ASSERT1(liberties == 1 || liberties == 2, NO_MOVE);
+
+  for (k = 0; k < lowlib_count[color]; k++) {
+    int s = lowlib_strings[color][k];
+    int origin = string[s].origin;
+    if (board[origin] == color && string_number[origin] == s
+	&& string[s].liberties == liberties)
+      strings[n++] = origin;
+  }
+
+  return n;
+}
+
+
 /* Find the liberties of the string at str. str must not be
  * empty. The locations of up to maxlib liberties are written into
  * libs[]. The full number of liberties is returned.
@@ -1779,7 +2384,7 @@ struct board_cache_entry {
 
 
 /* approxlib() cache. */
-static struct board_cache_entry approxlib_cache[BOARDMAX][2];
+static BOARD_LOCAL struct board_cache_entry approxlib_cache[BOARDMAX][2];
 
 
 /* Clears approxlib() cache. This function should be called only once
@@ -2071,7 +2676,7 @@ slow_approxlib(int pos, int color, int maxlib, int *libs)
 
 
 /* accuratelib() cache. */
-static struct board_cache_entry accuratelib_cache[BOARDMAX][2];
+static BOARD_LOCAL struct board_cache_entry accuratelib_cache[BOARDMAX][2];
 
 
 /* Clears accuratelib() cache. This function should be called only once
@@ -2597,7 +3202,7 @@ int
 chainlinks(int str, int adj[MAXCHAIN])
 {
   struct string_data *s;
-  struct string_neighbors_data *sn;
+  int *list;
   int k;
 
   ASSERT1(IS_STONE(board[str]), str);
@@ -2606,9 +3211,9 @@ chainlinks(int str, int adj[MAXCHAIN])
    * desired information.
    */
   s = &string[string_number[str]];
-  sn = &string_neighbors[string_number[str]];
+  list = NEIGHBORS(string_number[str]);
   for (k = 0; k < s->neighbors; k++)
-    adj[k] = string[sn->list[k]].origin;
+    adj[k] = string[list[k]].origin;
 
   return s->neighbors;
 }
@@ -2623,7 +3228,7 @@ int
 chainlinks2(int str, int adj[MAXCHAIN], int lib)
 {
   struct string_data *s, *t;
-  struct string_neighbors_data *sn;
+  int *list;
   int k;
   int neighbors;
 
@@ -2634,9 +3239,9 @@ chainlinks2(int str, int adj[MAXCHAIN], int lib)
    */
   neighbors = 0;
   s = &string[string_number[str]];
-  sn = &string_neighbors[string_number[str]];
+  list = NEIGHBORS(string_number[str]);
   for (k = 0; k < s->neighbors; k++) {
-    t = &string[sn->list[k]];
+    t = &string[list[k]];
     if (t->liberties == lib)
       adj[neighbors++] = t->origin;
   }
@@ -2653,7 +3258,7 @@ int
 chainlinks3(int str, int adj[MAXCHAIN], int lib)
 {
   struct string_data *s, *t;
-  struct string_neighbors_data *sn;
+  int *list;
   int k;
   int neighbors;
 
@@ -2664,9 +3269,9 @@ chainlinks3(int str, int adj[MAXCHAIN], int lib)
    */
   neighbors = 0;
   s = &string[string_number[str]];
-  sn = &string_neighbors[string_number[str]];
+  list = NEIGHBORS(string_number[str]);
   for (k = 0; k < s->neighbors; k++) {
-    t = &string[sn->list[k]];
+    t = &string[list[k]];
     if (t->liberties <= lib)
       adj[neighbors++] = t->origin;
   }
@@ -2686,7 +3291,7 @@ int
 extended_chainlinks(int str, int adj[MAXCHAIN], int both_colors)
 {
   struct string_data *s;
-  struct string_neighbors_data *sn;
+  int *list;
   int n;
   int k;
   int r;
@@ -2699,10 +3304,10 @@ extended_chainlinks(int str, int adj[MAXCHAIN], int both_colors)
    * copy it and mark the strings.
    */
   s = &string[string_number[str]];
-  sn = &string_neighbors[string_number[str]];
+  list = NEIGHBORS(string_number[str]);
   string_mark++;
   for (n = 0; n < s->neighbors; n++) {
-    adj[n] = string[sn->list[n]].origin;
+    adj[n] = string[list[n]].origin;
     MARK_STRING(adj[n]);
   }
 
@@ -3004,7 +3609,7 @@ adjacent_strings(int str1, int str2)
   s2 = string_number[str2];
 
   for (k = 0; k < string[s1].neighbors; k++)
-    if (string_neighbors[s1].list[k] == s2)
+    if (NEIGHBORS(s1)[k] == s2)
       return 1;
 
   return 0;
@@ -3115,6 +3720,63 @@ is_ko_point(int pos)
 }
 
 
+/* Update hash, without ko contribution, to the position after color
+ * plays at pos. The stones removed by the move are found from the
+ * string data, so no trial move is needed. A string can only be
+ * captured at its last liberty, so over all moves each string is
+ * hashed at most once.
+ */
+static void
+hash_after_move(int pos, int color, Hash_data *hash)
+{
+  int other = OTHER_COLOR(color);
+  int captures = 0;
+  int k;
+
+  hashdata_invert_stone(hash, pos, color);
+
+  string_mark++;
+  for (k = 0; k < 4; k++) {
+    int pos2 = pos + delta[k];
+    if (board[pos2] == other && LIBERTIES(pos2) == 1
+	&& UNMARKED_STRING(pos2)) {
+      MARK_STRING(pos2);
+      hash_remove_string(pos2, hash);
+      captures++;
+    }
+  }
+
+  /* A suicide removes the new stone and the strings it joins, all of
+   * which have no other liberty.
+   */
+  if (captures == 0 && is_suicide(pos, color)) {
+    hashdata_invert_stone(hash, pos, color);
+    for (k = 0; k < 4; k++) {
+      int pos2 = pos + delta[k];
+      if (board[pos2] == color && UNMARKED_STRING(pos2)) {
+	MARK_STRING(pos2);
+	hash_remove_string(pos2, hash);
+      }
+    }
+  }
+}
+
+
+/* Remove the stones of the string at str from hash. */
+static void
+hash_remove_string(int str, Hash_data *hash)
+{
+  int s = string_number[str];
+  int color = string[s].color;
+  int pos = FIRST_STONE(s);
+
+  do {
+    hashdata_invert_stone(hash, pos, color);
+    pos = NEXT_STONE(pos);
+  } while (!BACK_TO_FIRST_STONE(s, pos));
+}
+
+
 /* Return true if a move by color at pos is a superko violation
  * according to the specified type of ko rules. This function does not
  * detect simple ko unless it's also a superko violation.
@@ -3123,14 +3785,15 @@ is_ko_point(int pos)
  * previous positions. For this to work correctly it's necessary to
  * remove the contribution to the hash from the simple ko position.
  * The move_history_hash array contains board hashes for previous
- * positions, also without simple ko position contributions.
+ * positions, also without simple ko position contributions, and they
+ * are looked up in superko_set.
  */
 static int
 is_superko_violation(int pos, int color, enum ko_rules type)
 {
   Hash_data this_board_hash = board_hash;
   Hash_data new_board_hash;
-  int k;
+  struct superko_entry *entry;
 
   /* No superko violations if the ko rule is not a superko rule. */
   if (type == NONE || type == SIMPLE)
@@ -3139,11 +3802,8 @@ is_superko_violation(int pos, int color, enum ko_rules type)
   if (board_ko_pos != NO_MOVE)
     hashdata_invert_ko(&this_board_hash, board_ko_pos);
 
-  really_do_trymove(pos, color);
-  new_board_hash = board_hash;
-  if (board_ko_pos != NO_MOVE)
-    hashdata_invert_ko(&new_board_hash, board_ko_pos);
-  undo_trymove();
+  new_board_hash = this_board_hash;
+  hash_after_move(pos, color, &new_board_hash);
 
   /* The current position is only a problem with positional superko
    * and a single stone suicide.
@@ -3151,13 +3811,12 @@ is_superko_violation(int pos, int color, enum ko_rules type)
   if (type == PSK && hashdata_is_equal(this_board_hash, new_board_hash))
     return 1;
 
-  for (k = move_history_pointer - 1; k >= 0; k--)
-    if (hashdata_is_equal(move_history_hash[k], new_board_hash)
-	&& (type == PSK
-	    || move_history_color[k] == OTHER_COLOR(color)))
-      return 1;
-
-  return 0;
+  entry = superko_set_find(&new_board_hash);
+  if (!entry->used)
+    return 0;
+  if (type == PSK)
+    return entry->to_move[WHITE] > 0 || entry->to_move[BLACK] > 0;
+  return entry->to_move[OTHER_COLOR(color)] > 0;
 }
 
 /* Returns 1 if at least one string is captured when color plays at pos.
@@ -3235,9 +3894,9 @@ get_move_from_stack(int k, int *move, int *color)
 int
 stones_on_board(int color)
 {
-  static int stone_count_for_position = -1;
-  static int white_stones = 0;
-  static int black_stones = 0;
+  static BOARD_LOCAL int stone_count_for_position = -1;
+  static BOARD_LOCAL int white_stones = 0;
+  static BOARD_LOCAL int black_stones = 0;
 
   gg_assert(stackp == 0);
 
@@ -3245,7 +3904,7 @@ stones_on_board(int color)
     int pos;
     white_stones = 0;
     black_stones = 0;
-    for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
       if (board[pos] == WHITE)
 	white_stones++;
       else if (board[pos] == BLACK)
@@ -3304,25 +3963,25 @@ new_position(void)
 
   position_number++;
   next_string = 0;
+  next_neighbor = 0;
   liberty_mark = 0;
   string_mark = 0;
   CLEAR_STACKS();
 
   memset(string, 0, sizeof(string));
   memset(string_libs, 0, sizeof(string_libs));
-  memset(string_neighbors, 0, sizeof(string_neighbors));
   memset(ml, 0, sizeof(ml));
   VALGRIND_MAKE_WRITABLE(next_stone, sizeof(next_stone));
 
   /* propagate_string relies on non-assigned stones to have
    * string_number -1.
    */
-  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++)
     if (ON_BOARD(pos))
       string_number[pos] = -1;
 
   /* Find the existing strings. */
-  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
     if (!ON_BOARD(pos))
       continue;
     if (IS_STONE(board[pos]) && string_number[pos] == -1) {
@@ -3337,8 +3996,23 @@ new_position(void)
   }
   
   /* Fill in liberty and neighbor info. */
+  memset(lowlib_count, 0, sizeof(lowlib_count));
   for (s = 0; s < next_string; s++) {
+    /* The list is at the end of the used space, so it can be given
+     * all the room it may need and be trimmed afterwards. Leave room
+     * for some more neighbors.
+     */
+    string[s].neighbor_list = next_neighbor;
+    string[s].max_neighbors = MAXCHAIN;
     find_liberties_and_neighbors(s);
+    string[s].max_neighbors = gg_min(gg_max(4, 2 * string[s].neighbors),
+				     MAXCHAIN);
+    next_neighbor += string[s].max_neighbors;
+    if (string[s].liberties <= 2) {
+      int color = string[s].color;
+      lowlib_strings[color][lowlib_count[color]++] = s;
+      string[s].lowlib = lowlib_count[color];
+    }
   }
 }
 
@@ -3547,16 +4221,16 @@ remove_neighbor(int str_number, int n)
   int k;
   int done = 0;
   struct string_data *s = &string[str_number];
-  struct string_neighbors_data *sn = &string_neighbors[str_number];
+  int *list = NEIGHBORS(str_number);
   for (k = 0; k < s->neighbors; k++)
-    if (sn->list[k] == n) {
+    if (list[k] == n) {
       /* We need to push the last entry too because it may become
        * destroyed later.
        */
-      PUSH_VALUE(sn->list[s->neighbors - 1]);
-      PUSH_VALUE(sn->list[k]);
+      PUSH_VALUE(list[s->neighbors - 1]);
+      PUSH_VALUE(list[k]);
       PUSH_VALUE(s->neighbors);
-      sn->list[k] = sn->list[s->neighbors - 1];
+      list[k] = list[s->neighbors - 1];
       s->neighbors--;
       done = 1;
       break;
@@ -3565,6 +4239,30 @@ remove_neighbor(int str_number, int n)
 }
 
 
+/* Move the full neighbor list of a string to the end of the used part
+ * of string_neighbors[], doubling its room, and push the changed
+ * information.
+ */
+
+static void
+grow_neighbor_list(int s)
+{
+  int max_neighbors = gg_min(2 * string[s].max_neighbors, MAXCHAIN);
+
+  gg_assert(string[s].neighbors < MAXCHAIN);
+  gg_assert(next_neighbor + max_neighbors <= NEIGHBOR_POOL_SIZE);
+  memcpy(string_neighbors + next_neighbor, NEIGHBORS(s),
+	 string[s].neighbors * sizeof(int));
+
+  PUSH_VALUE(string[s].neighbor_list);
+  PUSH_VALUE(string[s].max_neighbors);
+  PUSH_VALUE(next_neighbor);
+  string[s].neighbor_list = next_neighbor;
+  string[s].max_neighbors = max_neighbors;
+  next_neighbor += max_neighbors;
+}
+
+
 /* Remove one liberty from the list of liberties, pushing changed
  * information. If the string had more liberties than the size of the
  * list, rebuild the list from scratch.
@@ -3590,12 +4288,69 @@ remove_liberty(int str_number, int pos)
 	PUSH_VALUE(s->liberties);
 	sl->list[k] = sl->list[s->liberties - 1];
 	s->liberties--;
+	update_lowlib(str_number);
 	break;
       }
   }
 }
 
 
+/* Add the string s to the low liberty list of its color if it has
+ * two liberties or less and is not listed already. Only the length of
+ * the list needs to be pushed. The index kept in the string is checked
+ * against the list, so it is no longer believed once the addition has
+ * been undone.
+ */
+
+static void
+update_lowlib(int s)
+{
+  int color;
+  int k;
+
+  if (string[s].liberties > 2)
+    return;
+
+  color = string[s].color;
+  k = string[s].lowlib - 1;
+  if (k >= 0 && k < lowlib_count[color] && lowlib_strings[color][k] == s)
+    return;
+
+  PUSH_VALUE(lowlib_count[color]);
+  string[s].lowlib = lowlib_count[color] + 1;
+  lowlib_strings[color][lowlib_count[color]++] = s;
+}
+
+
+/* Drop the strings which no longer exist or no longer have two
+ * liberties or less from the low liberty lists. Nothing is pushed, so
+ * this may only be called when the stacks are cleared afterwards.
+ */
+
+static void
+clean_lowlib_lists(void)
+{
+  int color;
+  int k;
+
+  for (color = WHITE; color <= BLACK; color++) {
+    int n = 0;
+    for (k = 0; k < lowlib_count[color]; k++) {
+      int s = lowlib_strings[color][k];
+      int origin = string[s].origin;
+      if (board[origin] == color && string_number[origin] == s
+	  && string[s].liberties <= 2) {
+	lowlib_strings[color][n++] = s;
+	string[s].lowlib = n;
+      }
+      else
+	string[s].lowlib = 0;
+    }
+    lowlib_count[color] = n;
+  }
+}
+
+
 /* Remove a string from the board, pushing necessary information to
  * restore it. Return the number of removed stones.
  */
@@ -3624,7 +4379,7 @@ do_remove_string(int s)
    */
   if (size == 1) {
     for (k = 0; k < string[s].neighbors; k++) {
-      int neighbor = string_neighbors[s].list[k];
+      int neighbor = NEIGHBORS(s)[k];
 
       remove_neighbor(neighbor, s);
       PUSH_VALUE(string[neighbor].liberties);
@@ -3639,7 +4394,7 @@ do_remove_string(int s)
     int pos2 = NEXT_STONE(pos);
 
     for (k = 0; k < string[s].neighbors; k++) {
-      int neighbor = string_neighbors[s].list[k];      
+      int neighbor = NEIGHBORS(s)[k];      
 
       remove_neighbor(neighbor, s);
       PUSH_VALUE(string[neighbor].liberties);
@@ -3659,8 +4414,8 @@ do_remove_string(int s)
   }
   else {
     for (k = 0; k < string[s].neighbors; k++) {
-      remove_neighbor(string_neighbors[s].list[k], s);
-      update_liberties(string_neighbors[s].list[k]);
+      remove_neighbor(NEIGHBORS(s)[k], s);
+      update_liberties(NEIGHBORS(s)[k]);
     }
   }
 
@@ -3701,6 +4456,13 @@ create_new_string(int pos)
   string[s].liberties = 0;
   string[s].neighbors = 0;
   string[s].mark = 0;
+  string[s].lowlib = 0;
+
+  /* A single stone has at most four neighbors. */
+  PUSH_VALUE(next_neighbor);
+  string[s].neighbor_list = next_neighbor;
+  string[s].max_neighbors = 4;
+  next_neighbor += 4;
 
   /* Clear the string mark. */
   string_mark++;
@@ -3762,6 +4524,8 @@ create_new_string(int pos)
     MARK_STRING(EAST(pos));
 #endif
   }
+
+  update_lowlib(s);
 }
 
 
@@ -3811,7 +4575,7 @@ extend_neighbor_string(int pos, int s)
   /* Mark old neighbors of the string. */
   string_mark++;
   for (k = 0; k < string[s].neighbors; k++)
-    string[string_neighbors[s].list[k]].mark = string_mark;
+    string[NEIGHBORS(s)[k]].mark = string_mark;
 
   /* Look at the neighbor locations of pos for new liberties and/or
    * neighbor strings.
@@ -3877,7 +4641,8 @@ extend_neighbor_string(int pos, int s)
     MARK_STRING(EAST(pos));
 #endif
   }
-  
+
+  update_lowlib(s);
 }
 
 
@@ -3949,12 +4714,12 @@ assimilate_string(int s, int pos)
    * function is called.
    */
   for (k = 0; k < string[s2].neighbors; k++) {
-    int t = string_neighbors[s2].list[k];
+    int t = NEIGHBORS(s2)[k];
     remove_neighbor(t, s2);
     if (string[t].mark != string_mark) {
       PUSH_VALUE(string[t].neighbors);
-      string_neighbors[t].list[string[t].neighbors++] = s;
-      string_neighbors[s].list[string[s].neighbors++] = t;
+      ADD_NEIGHBOR_STRING(t, s);
+      ADD_NEIGHBOR_STRING(s, t);
       string[t].mark = string_mark;
     }
   }
@@ -3969,8 +4734,10 @@ static void
 assimilate_neighbor_strings(int pos)
 {
   int s;
+  int k;
   int color = board[pos];
   int other = OTHER_COLOR(color);
+  int max_neighbors = 4;
 
   /* Get the next free string number. */
   PUSH_VALUE(next_string);
@@ -3986,6 +4753,18 @@ assimilate_neighbor_strings(int pos)
   string[s].origin = pos;
   string[s].liberties = 0;
   string[s].neighbors = 0;
+  string[s].lowlib = 0;
+
+  /* The new string has no other neighbors than those of the strings
+   * it assimilates and of the new stone.
+   */
+  for (k = 0; k < 4; k++)
+    if (board[pos + delta[k]] == color)
+      max_neighbors += string[string_number[pos + delta[k]]].neighbors;
+  PUSH_VALUE(next_neighbor);
+  string[s].neighbor_list = next_neighbor;
+  string[s].max_neighbors = gg_min(max_neighbors, MAXCHAIN);
+  next_neighbor += string[s].max_neighbors;
 
   /* Clear the marks. */
   liberty_mark++;
@@ -4058,6 +4837,8 @@ assimilate_neighbor_strings(int pos)
   else if (UNMARKED_COLOR_STRING(EAST(pos), color)) {
     assimilate_string(s, EAST(pos));
   }
+
+  update_lowlib(s);
 }
 
 
@@ -4291,7 +5072,7 @@ incremental_order_moves(int move, int color, int str,
 	struct string_data *t; \
 	(*captured_stones) += string[s].size; \
 	for (r = 0; r < string[s].neighbors; r++) { \
-	  t = &string[string_neighbors[s].list[r]]; \
+	  t = &string[NEIGHBORS(s)[r]]; \
 	  if (t->liberties == 1) \
 	    (*saved_stones) += t->size; \
 	} \
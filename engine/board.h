@@ -69,28 +69,28 @@ typedef unsigned char Intersection;
  * liberty and each empty point can provide a liberty to at most four
  * strings, at least one out of five board points must be empty.
  *
- * FIXME: This is not sufficiently large. Above stackp==0, the
- *        incremental board code doesn't re-use the entries for
- *        removed or merged strings, while new strings require new
- *        entries. This is a problem only in very pathological cases,
- *        and is extremely unlikely to occur in practice.
- *
- *        Actually, in the not all that pathological case of a
- *        repeated triple ko cycle, each move creates a new string and
- *        thus makes use of one more string, which relatively quickly
- *        will exhaust the available strings. For a safe upper bound
- *        MAX_STRINGS should be set to
- *        MAX_STACK + 4 * MAX_BOARD * MAX_BOARD / 5.
- *        It's not clear that it's worth the extra memory, however.
+ * Above stackp==0, the incremental board code doesn't re-use the
+ * entries for removed or merged strings, while new strings require
+ * new entries. Every trial move can thus use up one more string, and
+ * random playouts, which read down to nearly MAXSTACK, do so quickly
+ * on boards smaller than MAX_BOARD. Hence the extra MAXSTACK entries.
  */
-#define MAX_STRINGS (4 * MAX_BOARD * MAX_BOARD / 5)
+#define MAX_STRINGS (MAXSTACK + 4 * MAX_BOARD * MAX_BOARD / 5)
 
 /* Per gf: Unconditional_life() can get very close to filling the 
  * entire board under certain circumstances. This was discussed in 
  * the list around August 21, 2001, in a thread with the subject 
  * "gnugo bug logs".
+ *
+ * The stack is not made smaller than for 19x19 when MAX_BOARD is
+ * lowered. Random playouts read down to nearly MAXSTACK, and should
+ * give the same games in every build.
  */
-#define MAXSTACK  MAX_BOARD * MAX_BOARD
+#if MAX_BOARD < 19
+#define MAXSTACK  (19 * 19)
+#else
+#define MAXSTACK  (MAX_BOARD * MAX_BOARD)
+#endif
 #define MAXCHAIN  160
 
 #define HASH_RANDOM_SEED 12345
@@ -102,8 +102,14 @@ typedef unsigned char Intersection;
 /* Board sizes */
 
 
+/* MAX_BOARD sets the stride of the board arrays and can be lowered at
+ * configure time (cmake -DMAX_BOARD=9) for an engine which only plays
+ * on small boards.
+ */
 #define MIN_BOARD          1       /* Minimum supported board size.   */
+#ifndef MAX_BOARD
 #define MAX_BOARD         19       /* Maximum supported board size.   */
+#endif
 #define MAX_HANDICAP       9       /* Maximum supported handicap.     */
 #define MAX_MOVE_HISTORY 500       /* Max number of moves remembered. */
 
@@ -141,6 +147,10 @@ const char *color_to_string(int color);
 #define BOARDSIZE     ((MAX_BOARD + 2) * (MAX_BOARD + 1) + 1)
 #define BOARDMIN      (MAX_BOARD + 2)
 #define BOARDMAX      (MAX_BOARD + 1) * (MAX_BOARD + 1)
+/* All points of the current board lie below BOARD_LAST, which loops
+ * over the board may use instead of BOARDMAX on smaller boards.
+ */
+#define BOARD_LAST    (POS(board_size - 1, board_size - 1) + 1)
 #define POS(i, j)     ((MAX_BOARD + 2) + (i) * (MAX_BOARD + 1) + (j))
 #define DELTA(di, dj) ((di) * (MAX_BOARD + 1) + (dj))
 #define I(pos)        ((pos) / (MAX_BOARD + 1) - 1)
@@ -183,27 +193,48 @@ const char *color_to_string(int color);
 /*                         global variables                         */
 /* ================================================================ */
 
-/* The board and the other parameters deciding the current position. */
-extern int          board_size;             /* board size (usually 19) */
-extern Intersection board[BOARDSIZE];       /* go board */
-extern int          board_ko_pos;
-extern int          black_captured;   /* num. of black stones captured */
-extern int          white_captured;
-
-extern Intersection initial_board[BOARDSIZE];
-extern int          initial_board_ko_pos;
-extern int          initial_white_captured;
-extern int          initial_black_captured;
-extern int          move_history_color[MAX_MOVE_HISTORY];
-extern int          move_history_pos[MAX_MOVE_HISTORY];
-extern Hash_data    move_history_hash[MAX_MOVE_HISTORY];
-extern int          move_history_pointer;
-
-extern float        komi;
-extern int          handicap;     /* used internally in chinese scoring */
-extern int          movenum;      /* movenumber - used for debug output */
+/* The board and the other parameters deciding the current position.
+ *
+ * All of the board state, including the reading stack in board.c, the
+ * reading cache and the statistics, is BOARD_LOCAL (see hash.h). When
+ * the engine is compiled with THREADED_BOARD, each thread thus has a
+ * board of its own, on which it can play moves and do tactical
+ * reading independently of other threads. A new thread starts out
+ * with an empty board of the default size. It may take over a
+ * position from another thread by restoring a snapshot of it with
+ * restore_board_snapshot(), and it must call reading_cache_init()
+ * before doing any tactical reading.
+ *
+ * THREADED_BOARD gives per-thread tactical reading, not per-thread
+ * games. It covers the board and reading state and the ladder features
+ * read for the network inputs only. The rules, the reading depths and
+ * the Zobrist tables are shared and must not be changed while other
+ * threads read. So are the higher level analysis (worms, dragons,
+ * owl), the network evaluation state in nneval.c, the analysis cache
+ * in genmove.c, the Monte Carlo tree and the gg_urand() state, none of
+ * which is thread safe. Only one thread at a time may generate moves,
+ * and init_gnugo() must have returned before other threads start.
+ */
+extern BOARD_LOCAL int          board_size;             /* board size (usually 19) */
+extern BOARD_LOCAL Intersection board[BOARDSIZE];       /* go board */
+extern BOARD_LOCAL int          board_ko_pos;
+extern BOARD_LOCAL int          black_captured;   /* num. of black stones captured */
+extern BOARD_LOCAL int          white_captured;
+
+extern BOARD_LOCAL Intersection initial_board[BOARDSIZE];
+extern BOARD_LOCAL int          initial_board_ko_pos;
+extern BOARD_LOCAL int          initial_white_captured;
+extern BOARD_LOCAL int          initial_black_captured;
+extern BOARD_LOCAL int          move_history_color[MAX_MOVE_HISTORY];
+extern BOARD_LOCAL int          move_history_pos[MAX_MOVE_HISTORY];
+extern BOARD_LOCAL Hash_data    move_history_hash[MAX_MOVE_HISTORY];
+extern BOARD_LOCAL int          move_history_pointer;
+
+extern BOARD_LOCAL float        komi;
+extern BOARD_LOCAL int          handicap;     /* used internally in chinese scoring */
+extern BOARD_LOCAL int          movenum;      /* movenumber - used for debug output */
 		    
-extern signed char  shadow[BOARDMAX];      /* reading tree shadow */
+extern BOARD_LOCAL signed char  shadow[BOARDMAX];      /* reading tree shadow */
 
 enum suicide_rules {
   FORBIDDEN,
@@ -221,38 +252,18 @@ enum ko_rules {
 extern enum ko_rules ko_rule;
 
 
-extern int stackp;                /* stack pointer */
-extern int count_variations;      /* count (decidestring) */
-extern SGFTree *sgf_dumptree;
-
+extern BOARD_LOCAL int stackp;                /* stack pointer */
+extern BOARD_LOCAL int count_variations;      /* count (decidestring) */
+extern BOARD_LOCAL SGFTree *sgf_dumptree;
 
-/* This struct holds the internal board state. */
-struct board_state {
-  int board_size;
 
-  Intersection board[BOARDSIZE];
-  int board_ko_pos;
-  int black_captured;
-  int white_captured;
-
-  Intersection initial_board[BOARDSIZE];
-  int initial_board_ko_pos;
-  int initial_white_captured;
-  int initial_black_captured;
-  int move_history_color[MAX_MOVE_HISTORY];
-  int move_history_pos[MAX_MOVE_HISTORY];
-  Hash_data move_history_hash[MAX_MOVE_HISTORY];
-  int move_history_pointer;
-
-  float komi;
-  int handicap;
-  int move_number;
-};
+/* Snapshot of the permanent board state, see board.c. */
+struct board_snapshot;
 
 /* This is increased by one anytime a move is (permanently) played or
  * the board is cleared.
  */
-extern int position_number;
+extern BOARD_LOCAL int position_number;
 
 /* ================================================================ */
 /*                        board.c functions                         */
@@ -269,8 +280,9 @@ void remove_stone(int pos);
 void play_move(int pos, int color);
 int undo_move(int n);
 
-void store_board(struct board_state *state);
-void restore_board(struct board_state *state);
+struct board_snapshot *take_board_snapshot(void);
+void restore_board_snapshot(const struct board_snapshot *snapshot);
+void free_board_snapshot(struct board_snapshot *snapshot);
 
 /* Information about the permanent board. */
 int get_last_move(void);
@@ -302,6 +314,9 @@ int is_legal(int pos, int color);
 int is_suicide(int pos, int color);
 int is_illegal_ko_capture(int pos, int color);
 int is_allowed_move(int pos, int color);
+int find_allowed_moves(int color, signed char allowed[BOARDMAX],
+		       int exclude_own_eyes);
+int is_own_eye(int pos, int color);
 int is_ko(int pos, int color, int *ko_pos);
 int is_ko_point(int pos);
 int does_capture_something(int pos, int color);
@@ -333,6 +348,7 @@ int are_neighbors(int pos1, int pos2);
 /* Count and/or find liberties at (pos). */
 int countlib(int str);
 int findlib(int str, int maxlib, int *libs);
+int find_lowlib_strings(int color, int liberties, int *strings);
 int fastlib(int pos, int color, int ignore_captures);
 int approxlib(int pos, int color, int maxlib, int *libs);
 int accuratelib(int pos, int color, int maxlib, int *libs);
@@ -412,7 +428,7 @@ struct stats_data {
                                  /* with sufficient remaining depth. */
 };
 
-extern struct stats_data stats;
+extern BOARD_LOCAL struct stats_data stats;
 
 
 /* printutils.c */
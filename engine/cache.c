@@ -43,7 +43,7 @@ static void tt_init(Transposition_table *table, int memsize);
 static void tt_clear(Transposition_table *table);
 
 /* The transposition table itself. */
-Transposition_table ttable;
+BOARD_LOCAL Transposition_table ttable;
 
 
 /* Arrays with random numbers for Zobrist hashing of input data (other
@@ -0,0 +1,407 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Convert a network trained with DeepCL into a DGNN network file
+ * (see nnmodel.h) that the engine can map into memory.
+ *
+ * Usage: deepcl2nn [--planes n] [--size n] [--fp16] [--ladder] netdef
+ *                  weightsfile outfile
+ *
+ * DeepCL does not store the network architecture in its weights
+ * file, so the netdef used for training must be given again, e.g.
+ *
+ *   deepcl2nn 3*(64c5z-relu)-1c1z weights.dat network.dgnn
+ *
+ * Supported netdef layers are NcKz convolutions (Nc1 is also
+ * accepted), Nn fully connected layers, relu, tanh, sigmoid and
+ * linear activations, and repetitions M*(...). Dropout layers are
+ * skipped. A softmax layer is appended, as DeepCL does.
+ *
+ * The weights file starts with a 1024 byte header, beginning with
+ * "ClCn", followed by the float weights of each layer in netdef
+ * order: [filters][planes][rows][columns], then the biases.
+ *
+ * With --fp16 the convolution weights are stored in half precision,
+ * rounded to nearest. --ladder marks a network trained with the two
+ * ladder planes after the 7 kgsgo planes (NN_FEATURES_KGSGO_LADDER).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "nnmodel.h"
+
+#define DEEPCL_MAGIC        "ClCn"
+#define DEEPCL_HEADER_SIZE  1024
+
+#define MAX_LAYERS   500
+#define MAX_NETDEF   10000
+
+static struct nn_layer_desc layers[MAX_LAYERS];
+static int num_layers = 0;
+
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+	  "Usage: deepcl2nn [--planes n] [--size n] [--fp16] [--ladder] netdef weightsfile outfile\n");
+  exit(EXIT_FAILURE);
+}
+
+
+/* Expand M*(...) repetitions, writing the flat netdef to out. */
+static const char *
+expand_netdef(const char *s, char *out, int *len, int depth)
+{
+  while (*s && *s != ')') {
+    const char *p = s;
+    int count = 0;
+
+    while (isdigit((int) *p))
+      count = 10 * count + (*p++ - '0');
+
+    if (p > s && *p == '*' && p[1] == '(') {
+      const char *body = p + 2;
+      const char *end = NULL;
+      int k;
+
+      if (depth > 10) {
+	fprintf(stderr, "deepcl2nn: netdef nested too deeply\n");
+	exit(EXIT_FAILURE);
+      }
+      for (k = 0; k < count; k++) {
+	if (k > 0 && *len < MAX_NETDEF - 1)
+	  out[(*len)++] = '-';
+	end = expand_netdef(body, out, len, depth + 1);
+      }
+      if (!end || *end != ')') {
+	fprintf(stderr, "deepcl2nn: unbalanced parentheses in netdef\n");
+	exit(EXIT_FAILURE);
+      }
+      s = end + 1;
+    }
+    else {
+      if (*len >= MAX_NETDEF - 1) {
+	fprintf(stderr, "deepcl2nn: netdef too long\n");
+	exit(EXIT_FAILURE);
+      }
+      out[(*len)++] = *s++;
+    }
+  }
+  out[*len] = '\0';
+  return s;
+}
+
+
+static struct nn_layer_desc *
+add_layer(int type, int out_planes)
+{
+  struct nn_layer_desc *d;
+
+  if (num_layers == MAX_LAYERS) {
+    fprintf(stderr, "deepcl2nn: too many layers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  d = &layers[num_layers];
+  memset(d, 0, sizeof(*d));
+  d->type = type;
+  d->input = num_layers - 1;
+  d->in_planes = (num_layers > 0 ? layers[num_layers - 1].out_planes : 0);
+  d->out_planes = out_planes;
+  num_layers++;
+  return d;
+}
+
+
+/* Translate one netdef token into a layer. */
+static void
+parse_token(const char *token, int input_planes, int size, int *spatial)
+{
+  int n, k;
+  char z[2];
+  struct nn_layer_desc *d;
+
+  if (strcmp(token, "relu") == 0
+      || strcmp(token, "tanh") == 0
+      || strcmp(token, "sigmoid") == 0) {
+    if (num_layers == 0) {
+      fprintf(stderr, "deepcl2nn: activation '%s' before any layer\n", token);
+      exit(EXIT_FAILURE);
+    }
+    d = add_layer(NN_LAYER_ACTIVATION, layers[num_layers - 1].out_planes);
+    if (token[0] == 'r')
+      d->activation = NN_ACT_RELU;
+    else if (token[0] == 't')
+      d->activation = NN_ACT_TANH;
+    else
+      d->activation = NN_ACT_SIGMOID;
+  }
+  else if (strcmp(token, "linear") == 0
+	   || strncmp(token, "drop", 4) == 0)
+    return;
+  else if (strcmp(token, "softmax") == 0) {
+    if (num_layers == 0) {
+      fprintf(stderr, "deepcl2nn: softmax before any layer\n");
+      exit(EXIT_FAILURE);
+    }
+    add_layer(NN_LAYER_SOFTMAX, layers[num_layers - 1].out_planes);
+  }
+  else if (sscanf(token, "%dc%d%1s", &n, &k, z) >= 2) {
+    if (n <= 0 || k <= 0 || k % 2 == 0
+	|| (k > 1 && strcmp(token + strlen(token) - 1, "z") != 0)) {
+      fprintf(stderr, "deepcl2nn: unsupported convolution '%s' "
+	      "(only odd, zero padded kernels)\n", token);
+      exit(EXIT_FAILURE);
+    }
+    if (*spatial != size * size) {
+      fprintf(stderr, "deepcl2nn: convolution after fully connected layer\n");
+      exit(EXIT_FAILURE);
+    }
+    d = add_layer(NN_LAYER_CONV, n);
+    d->kernel = k;
+    if (num_layers == 1)
+      d->in_planes = input_planes;
+    d->weights_count = n * d->in_planes * k * k;
+    d->bias_count = n;
+  }
+  else if (sscanf(token, "%dn%1s", &n, z) == 1 && n > 0) {
+    d = add_layer(NN_LAYER_FC, n);
+    if (num_layers == 1)
+      d->in_planes = input_planes;
+    d->weights_count = n * d->in_planes * *spatial;
+    d->bias_count = n;
+    *spatial = 1;
+  }
+  else {
+    fprintf(stderr, "deepcl2nn: unsupported netdef layer '%s'\n", token);
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+/* Copy count floats from the weights file to the output file. */
+static void
+copy_floats(FILE *in, FILE *out, unsigned int count)
+{
+  float buf[1024];
+
+  while (count > 0) {
+    size_t chunk = count < 1024 ? count : 1024;
+    if (fread(buf, sizeof(float), chunk, in) != chunk) {
+      fprintf(stderr, "deepcl2nn: weights file too short for netdef\n");
+      exit(EXIT_FAILURE);
+    }
+    if (fwrite(buf, sizeof(float), chunk, out) != chunk) {
+      perror("deepcl2nn");
+      exit(EXIT_FAILURE);
+    }
+    count -= chunk;
+  }
+}
+
+
+/* Copy count floats from the weights file to the output file as half
+ * precision values.
+ */
+static void
+copy_halves(FILE *in, FILE *out, unsigned int count)
+{
+  float buf[1024];
+  unsigned short half[1024];
+  size_t k;
+
+  while (count > 0) {
+    size_t chunk = count < 1024 ? count : 1024;
+    if (fread(buf, sizeof(float), chunk, in) != chunk) {
+      fprintf(stderr, "deepcl2nn: weights file too short for netdef\n");
+      exit(EXIT_FAILURE);
+    }
+    for (k = 0; k < chunk; k++)
+      half[k] = nn_float_to_half(buf[k]);
+    if (fwrite(half, sizeof(unsigned short), chunk, out) != chunk) {
+      perror("deepcl2nn");
+      exit(EXIT_FAILURE);
+    }
+    count -= chunk;
+  }
+}
+
+
+static void
+pad_to(FILE *out, unsigned int offset)
+{
+  long pos = ftell(out);
+  while (pos >= 0 && (unsigned long) pos < offset) {
+    fputc(0, out);
+    pos++;
+  }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  int input_planes = NN_KGSGO_PLANES;
+  int size = 19;
+  int spatial;
+  char netdef[MAX_NETDEF];
+  int len = 0;
+  char *token;
+  struct nn_file_header header;
+  size_t offset;
+  FILE *in;
+  FILE *out;
+  char magic[4];
+  int k;
+  int argi = 1;
+  int fp16 = 0;
+  int feature_set = NN_FEATURES_KGSGO;
+
+  while (argi + 1 < argc && strncmp(argv[argi], "--", 2) == 0) {
+    if (strcmp(argv[argi], "--fp16") == 0) {
+      fp16 = 1;
+      argi++;
+      continue;
+    }
+    if (strcmp(argv[argi], "--ladder") == 0) {
+      feature_set = NN_FEATURES_KGSGO_LADDER;
+      input_planes = NN_KGSGO_LADDER_PLANES;
+      argi++;
+      continue;
+    }
+    if (strcmp(argv[argi], "--planes") == 0)
+      input_planes = atoi(argv[argi + 1]);
+    else if (strcmp(argv[argi], "--size") == 0)
+      size = atoi(argv[argi + 1]);
+    else
+      usage();
+    argi += 2;
+  }
+  if (argc - argi != 3 || input_planes <= 0 || size <= 0 || size > 19)
+    usage();
+
+  expand_netdef(argv[argi], netdef, &len, 0);
+  spatial = size * size;
+  for (token = strtok(netdef, "-"); token; token = strtok(NULL, "-"))
+    parse_token(token, input_planes, size, &spatial);
+
+  if (num_layers == 0)
+    usage();
+  if (layers[num_layers - 1].type != NN_LAYER_SOFTMAX)
+    add_layer(NN_LAYER_SOFTMAX, layers[num_layers - 1].out_planes);
+  if (layers[num_layers - 1].out_planes * spatial != size * size) {
+    fprintf(stderr, "deepcl2nn: network has %d outputs, expected %d\n",
+	    layers[num_layers - 1].out_planes * spatial, size * size);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Lay out the tensors. */
+  offset = NN_ALIGN_UP(sizeof(header) + num_layers * sizeof(layers[0]));
+  for (k = 0; k < num_layers; k++) {
+    if (fp16 && layers[k].type == NN_LAYER_CONV)
+      layers[k].weights_format = NN_WEIGHTS_FLOAT16;
+    if (layers[k].weights_count > 0) {
+      size_t size = (layers[k].weights_format == NN_WEIGHTS_FLOAT16
+		     ? sizeof(unsigned short) : sizeof(float));
+      layers[k].weights_offset = offset;
+      offset = NN_ALIGN_UP(offset + layers[k].weights_count * size);
+    }
+    if (layers[k].bias_count > 0) {
+      layers[k].bias_offset = offset;
+      offset = NN_ALIGN_UP(offset + layers[k].bias_count * sizeof(float));
+    }
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NN_MODEL_MAGIC, 4);
+  header.version = NN_MODEL_VERSION;
+  header.byte_order = NN_MODEL_BYTE_ORDER;
+  header.header_size = sizeof(header);
+  header.layer_desc_size = sizeof(layers[0]);
+  header.num_layers = num_layers;
+  header.feature_set = feature_set;
+  header.input_planes = input_planes;
+  header.board_size = size;
+  header.file_size = offset;
+
+  in = fopen(argv[argi + 1], "rb");
+  if (!in) {
+    perror(argv[argi + 1]);
+    exit(EXIT_FAILURE);
+  }
+  if (fread(magic, 1, 4, in) != 4 || memcmp(magic, DEEPCL_MAGIC, 4) != 0) {
+    fprintf(stderr, "deepcl2nn: %s is not a DeepCL weights file\n",
+	    argv[argi + 1]);
+    exit(EXIT_FAILURE);
+  }
+  if (fseek(in, DEEPCL_HEADER_SIZE, SEEK_SET) != 0) {
+    perror(argv[argi + 1]);
+    exit(EXIT_FAILURE);
+  }
+
+  out = fopen(argv[argi + 2], "wb");
+  if (!out) {
+    perror(argv[argi + 2]);
+    exit(EXIT_FAILURE);
+  }
+
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(layers, sizeof(layers[0]), num_layers, out);
+  for (k = 0; k < num_layers; k++) {
+    if (layers[k].weights_count > 0) {
+      pad_to(out, layers[k].weights_offset);
+      if (layers[k].weights_format == NN_WEIGHTS_FLOAT16)
+	copy_halves(in, out, layers[k].weights_count);
+      else
+	copy_floats(in, out, layers[k].weights_count);
+    }
+    if (layers[k].bias_count > 0) {
+      pad_to(out, layers[k].bias_offset);
+      copy_floats(in, out, layers[k].bias_count);
+    }
+  }
+  pad_to(out, header.file_size);
+
+  if (fgetc(in) != EOF)
+    fprintf(stderr, "deepcl2nn: warning: weights file is longer than the netdef needs\n");
+
+  fclose(in);
+  if (fclose(out) != 0) {
+    perror(argv[argi + 2]);
+    exit(EXIT_FAILURE);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -26,10 +26,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "liberty.h"
 #include "sgftree.h"
 #include "gg_utils.h"
+#include "random.h"
 
 /* Return one if x doesn't equal position_number and 0 otherwise.
  * After using this macro x will always have the value
@@ -40,9 +42,19 @@
 
 static int do_genmove(int color, float pure_threat_value,
 		      int allowed_moves[BOARDMAX], float *value, int *resign);
+static int policy_genmove(int color);
 
 /* Position numbers for which various examinations were last made. */
 
+/* Network evaluation and search results of the last analyzed
+ * position, one entry for each color to move, indexed by
+ * color == WHITE. Queries about the same position reuse them, also
+ * when they alternate between the colors. last_analysis points to
+ * the entry analyzed most recently. Set up by clear_analysis().
+ */
+static struct position_analysis analysis[2];
+static struct position_analysis *last_analysis = &analysis[0];
+
 
 /* Reset some things in the engine. 
  *
@@ -76,6 +88,12 @@ genmove(int color, float *value, int *resign)
   if (resign)
     *resign = 0;
 
+  if (use_monte_carlo_genmove)
+    return analyze_position(color, 1)->best_move;
+
+  if (nn_policy_genmove && analyze_position(color, 0)->evaluated)
+    return policy_genmove(color);
+
   while(move < BOARDMAX)
   {
     if(ON_BOARD(move) && (board[move] == EMPTY))
@@ -92,6 +110,270 @@ genmove(int color, float *value, int *resign)
 }
 
 
+/* Fill in best_moves[] and best_move_values[] from the analysis a:
+ * the moves with most visits and their win rates after a search,
+ * otherwise the moves with highest prior.
+ */
+static void
+update_top_moves(const struct position_analysis *a)
+{
+  int pos;
+  int k;
+
+  for (k = 0; k < 10; k++) {
+    best_moves[k] = NO_MOVE;
+    best_move_values[k] = 0.0;
+  }
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    float key;
+    float val;
+
+    if (board[pos] != EMPTY)
+      continue;
+    if (a->searched) {
+      key = a->visits[pos];
+      val = a->win_rate[pos];
+    }
+    else
+      key = val = a->prior[pos];
+    if (key <= 0.0)
+      continue;
+
+    for (k = 10; k > 0; k--) {
+      int prev = best_moves[k - 1];
+      float prev_key;
+
+      if (prev == NO_MOVE)
+	continue;
+      if (a->searched)
+	prev_key = a->visits[prev];
+      else
+	prev_key = a->prior[prev];
+      if (prev_key >= key)
+	break;
+      if (k < 10) {
+	best_moves[k] = prev;
+	best_move_values[k] = best_move_values[k - 1];
+      }
+    }
+    if (k < 10) {
+      best_moves[k] = pos;
+      best_move_values[k] = val;
+    }
+  }
+}
+
+
+/* Forget the last analysis of both colors. */
+void
+clear_analysis(void)
+{
+  memset(analysis, 0, sizeof(analysis));
+  analysis[0].position_number = -1;
+  analysis[1].position_number = -1;
+  last_analysis = &analysis[0];
+}
+
+
+/* Until a search is made, the allowed move with highest prior is
+ * best.
+ */
+static void
+set_best_prior_move(struct position_analysis *a)
+{
+  float best_prior = 0.0;
+  int pos;
+
+  a->best_move = PASS_MOVE;
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+    if (a->allowed[pos] && a->prior[pos] > best_prior) {
+      a->best_move = pos;
+      best_prior = a->prior[pos];
+    }
+}
+
+
+/* Search results also depend on the number of simulations and on
+ * komi. If either has changed since the search, drop its results but
+ * keep the network evaluation.
+ */
+static void
+drop_stale_search(struct position_analysis *a)
+{
+  if (!a->searched
+      || (a->simulations == mc_games_per_level * get_level()
+	  && a->komi == komi))
+    return;
+
+  a->searched = 0;
+  a->total_visits = 0;
+  a->playouts = 0;
+  memset(a->visits, 0, sizeof(a->visits));
+  memset(a->win_rate, 0, sizeof(a->win_rate));
+  memset(a->ownership, 0, sizeof(a->ownership));
+  set_best_prior_move(a);
+  update_top_moves(a);
+}
+
+
+/* Analyze the current position with color to move. The network
+ * evaluation is always made, the Monte Carlo search only if search is
+ * nonzero. Results are kept for each color until the position
+ * changes, so repeated calls for the same position are cheap, whichever
+ * color they ask for.
+ */
+const struct position_analysis *
+analyze_position(int color, int search)
+{
+  struct position_analysis *a = &analysis[color == WHITE];
+
+  /* A network loaded in the background is swapped in here, between
+   * searches.
+   */
+  nn_swap_network();
+
+  if (a->position_number != position_number
+      || a->network != nn_network_generation()
+      || a->color != color) {
+    memset(a, 0, sizeof(*a));
+    a->position_number = position_number;
+    a->network = nn_network_generation();
+    a->color = color;
+    a->evaluated = nn_evaluate(color, a->prior, &a->value);
+    find_allowed_moves(color, a->allowed, 0);
+    set_best_prior_move(a);
+  }
+  else
+    drop_stale_search(a);
+
+  if (search && !a->searched) {
+    int pos;
+
+    a->simulations = mc_games_per_level * get_level();
+    a->komi = komi;
+    uct_genmove(color, &a->best_move, NULL, NULL,
+		a->simulations, a->win_rate, a->visits);
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+      a->total_visits += a->visits[pos];
+    a->playouts = uct_ownership(a->ownership);
+    a->searched = 1;
+  }
+
+  last_analysis = a;
+  update_top_moves(a);
+  return a;
+}
+
+
+/* Choose a move for color from the network policy alone, the one with
+ * highest prior or, with a positive nn_temperature, one sampled with
+ * probabilities proportional to prior^(1/nn_temperature). Moves not
+ * allowed by find_allowed_moves() are never chosen. This costs a single
+ * network evaluation.
+ */
+static int
+policy_genmove(int color)
+{
+  const struct position_analysis *a = analyze_position(color, 0);
+  float weight[BOARDMAX];
+  double sum = 0.0;
+  double r;
+  int pos;
+  int move = PASS_MOVE;
+
+  if (nn_temperature <= 0.0)
+    return a->best_move;
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    weight[pos] = 0.0;
+    if (a->allowed[pos] && a->prior[pos] > 0.0) {
+      weight[pos] = pow(a->prior[pos], 1.0 / nn_temperature);
+      sum += weight[pos];
+    }
+  }
+
+  if (sum <= 0.0)
+    return a->best_move;
+
+  r = gg_drand() * sum;
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    if (weight[pos] <= 0.0)
+      continue;
+    move = pos;
+    r -= weight[pos];
+    if (r < 0.0)
+      break;
+  }
+
+  return move;
+}
+
+
+/* The analysis of the current position, or NULL if the position or
+ * the network has changed since the last analysis. Search results are
+ * left out if the search settings have changed since the search.
+ */
+const struct position_analysis *
+current_analysis(void)
+{
+  struct position_analysis *a = last_analysis;
+
+  if (a->position_number != position_number
+      || a->network != nn_network_generation())
+    return NULL;
+  drop_stale_search(a);
+  return a;
+}
+
+
+/* Probability of each move being played, from the visit counts if the
+ * current position has been searched and otherwise from the network
+ * policy. All zero if nothing is known about the position.
+ */
+void
+compute_move_probabilities(float probabilities[BOARDMAX])
+{
+  const struct position_analysis *a = current_analysis();
+  int pos;
+
+  for (pos = 0; pos < BOARDMAX; pos++) {
+    probabilities[pos] = 0.0;
+    if (!a || board[pos] != EMPTY)
+      continue;
+    if (a->searched) {
+      if (a->total_visits > 0)
+	probabilities[pos] = (float) a->visits[pos] / a->total_visits;
+    }
+    else
+      probabilities[pos] = a->prior[pos];
+  }
+}
+
+
+/* Print prior, visits and win rate of every move with nonzero prior or
+ * visits in the analysis of the current position, one move per line.
+ */
+void
+print_all_move_values(FILE *output)
+{
+  const struct position_analysis *a = current_analysis();
+  int pos;
+
+  if (!a)
+    return;
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    if (board[pos] != EMPTY
+	|| (a->prior[pos] <= 0.0 && a->visits[pos] == 0))
+      continue;
+    gfprintf(output, "%1m", pos);
+    fprintf(output, " %.4f %d %.4f\n", a->prior[pos], a->visits[pos],
+	    a->win_rate[pos]);
+  }
+}
+
+
 /*
  * Local Variables:
  * tab-width: 8
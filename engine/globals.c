@@ -136,6 +136,32 @@ int mc_games_per_level = 8000;  /* By default, use 8000 times the current
 				 * move generation is enabled.
 				 */
 
+float nn_cache_size = -1;      /* Megabytes for the network evaluation
+				 * cache, negative for the default size.
+				 */
+int nn_cache_invariant = 0;     /* Share cache entries between rotated and
+				 * mirrored positions.
+				 */
+int nn_batch_size = 1;          /* Monte Carlo leaves evaluated by the
+				 * network together; 1 evaluates each
+				 * leaf directly.
+				 */
+int nn_symmetry = NN_SYMMETRY_NONE; /* Orientation of positions given to
+				     * the network.
+				     */
+float nn_value_lambda = 0.5;    /* Weight of the value head against the
+				 * playout result in Monte Carlo leaves.
+				 */
+int nn_threads = 1;             /* Threads sharing the work of each
+				 * network layer.
+				 */
+int nn_policy_genmove = 0;      /* Play the network's policy move without
+				 * any search.
+				 */
+float nn_temperature = 0.0;     /* Temperature for sampling policy moves,
+				 * 0 always plays the top move.
+				 */
+
 float best_move_values[10];
 int   best_moves[10];
 float white_score;
@@ -221,6 +221,14 @@ extern int mirror_stones_limit;      /* but stop at this number of stones */
 extern int gtp_version;              /* version of Go Text Protocol */
 extern int use_monte_carlo_genmove;  /* use Monte Carlo move generation */
 extern int mc_games_per_level;       /* number of Monte Carlo simulations per level */
+extern float nn_cache_size;          /* megabytes for network evaluation cache */
+extern int nn_cache_invariant;       /* orientation invariant cache keys */
+extern int nn_batch_size;            /* Monte Carlo leaves evaluated together */
+extern int nn_symmetry;              /* orientation(s) used for evaluation */
+extern float nn_value_lambda;        /* value head weight in Monte Carlo leaves */
+extern int nn_threads;               /* threads splitting each network layer */
+extern int nn_policy_genmove;        /* play policy moves without search */
+extern float nn_temperature;         /* temperature for sampling policy moves */
 
 /* Mandatory values of reading parameters. Normally -1, if set
  * these override the values derived from the level. */
@@ -351,6 +359,24 @@ int same_dragon(int dr1, int dr2);
 void prepare_pattern_profiling(void);
 void report_pattern_profiling(void);
 
+/* nneval.c */
+int nn_load_network(const char *filename);
+int nn_network_generation(void);
+int nn_swap_network(void);
+int nn_have_network(void);
+int nn_have_value_head(void);
+int nn_evaluate(int color, float policy[BOARDMAX], float *value);
+int nn_batch_capacity(void);
+int nn_batch_add(int color);
+void nn_batch_evaluate(void);
+void nn_batch_result(int index, float policy[BOARDMAX], float *value);
+void nn_set_symmetry(int mode);
+
+/* Values for nn_symmetry. */
+#define NN_SYMMETRY_NONE    0  /* evaluate the position as it is */
+#define NN_SYMMETRY_RANDOM  1  /* in one random orientation */
+#define NN_SYMMETRY_FULL    2  /* average over all 8 orientations */
+
 /* sgffile.c */
 void sgffile_add_debuginfo(SGFNode *node, float value);
 void sgffile_output(SGFTree *tree);
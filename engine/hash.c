@@ -143,7 +143,7 @@ hashdata_recalc(Hash_data *hd, Intersection *p, int ko_pos)
 
   hashdata_clear(hd);
   
-  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
     if (p[pos] == WHITE)
       hashdata_xor(*hd, white_hash[pos]);
     else if (p[pos] == BLACK)
@@ -196,17 +196,21 @@ hashdata_invert_kom_pos(Hash_data *hd, int kom_pos)
   hashdata_xor(*hd, kom_pos_hash[kom_pos]);
 }
 
-/* Calculate a transformation invariant hashvalue. */
-void 
+/* Calculate a transformation invariant hashvalue. The return value is
+ * the rotation (as used by rotate1()) which maps the position onto the
+ * canonical one the hash value was computed for.
+ */
+int
 hashdata_calc_orientation_invariant(Hash_data *hd, Intersection *p, int ko_pos)
 {
   int pos;
   int rot;
+  int best_rot = 0;
   Hash_data hd_rot;
 
   for (rot = 0; rot < 8; rot++) {
     hashdata_clear(&hd_rot);
-    for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
       if (p[pos] == WHITE)
 	hashdata_xor(hd_rot, white_hash[rotate1(pos, rot)]);
       else if (p[pos] == BLACK)
@@ -216,9 +220,13 @@ hashdata_calc_orientation_invariant(Hash_data *hd, Intersection *p, int ko_pos)
     if (ko_pos != NO_MOVE)
       hashdata_xor(hd_rot, ko_hash[rotate1(ko_pos, rot)]);
 
-    if (rot == 0 || hashdata_is_smaller(hd_rot, *hd))
+    if (rot == 0 || hashdata_is_smaller(hd_rot, *hd)) {
       *hd = hd_rot;
+      best_rot = rot;
+    }
   }
+
+  return best_rot;
 }
 
 /* Compute hash value to identify the goal area. */
@@ -230,7 +238,7 @@ goal_to_hashvalue(const signed char *goal)
   
   hashdata_clear(&return_value);
   
-  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++)
     if (ON_BOARD(pos) && goal[pos])
       hashdata_xor(return_value, goal_hash[pos]);
   
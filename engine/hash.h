@@ -27,6 +27,17 @@
 #include "config.h"
 #include <limits.h>
 
+/* Storage class of the board state, see board.h. */
+#if THREADED_BOARD
+#ifdef _MSC_VER
+#define BOARD_LOCAL __declspec(thread)
+#else
+#define BOARD_LOCAL __thread
+#endif
+#else
+#define BOARD_LOCAL
+#endif
+
 /*
  * This file, together with engine/hash.c implements hashing of go positions
  * using a method known as Zobrist hashing.  See the Texinfo documentation
@@ -83,7 +94,7 @@ typedef struct {
   Hashvalue hashval[NUM_HASHVALUES];
 } Hash_data;
 
-extern Hash_data board_hash;
+extern BOARD_LOCAL Hash_data board_hash;
 
 Hash_data goal_to_hashvalue(const signed char *goal);
 
@@ -98,8 +109,8 @@ void hashdata_invert_ko(Hash_data *hd, int pos);
 void hashdata_invert_stone(Hash_data *hd, int pos, int color);
 void hashdata_invert_komaster(Hash_data *hd, int komaster);
 void hashdata_invert_kom_pos(Hash_data *hd, int kom_pos);
-void hashdata_calc_orientation_invariant(Hash_data *hd, Intersection *board,
-					 int ko_pos);
+int hashdata_calc_orientation_invariant(Hash_data *hd, Intersection *board,
+					int ko_pos);
 
 char *hashdata_to_string(Hash_data *hashdata);
 
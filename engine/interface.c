@@ -29,6 +29,7 @@
 #include "sgftree.h"
 #include "liberty.h"
 #include "clock.h"
+#include "nncache.h"
 
 #include "gg_utils.h"
 
@@ -46,11 +47,13 @@ init_gnugo(float memory, unsigned int seed)
    */
   set_random_seed(HASH_RANDOM_SEED);
   reading_cache_init(memory * 1024 * 1024);
+  nn_cache_init(nn_cache_size < 0 ? -1 : (int) (nn_cache_size * 1024 * 1024));
   set_random_seed(seed);
   clear_board();
 
   clear_approxlib_cache();
   clear_accuratelib_cache();
+  clear_analysis();
 }
 
 
@@ -63,7 +66,9 @@ init_gnugo(float memory, unsigned int seed)
 int check_boardsize(int boardsize, FILE *out)
 {
   int max_board = MAX_BOARD;
-  if (use_monte_carlo_genmove && max_board > 9)
+
+  /* Playouts alone are too weak beyond 9x9. */
+  if (use_monte_carlo_genmove && !nn_have_network() && max_board > 9)
     max_board = 9;
   
   if (boardsize < MIN_BOARD || boardsize > max_board) {
@@ -216,6 +216,8 @@ int restricted_attack2(int str, int *move,
 		       int num_forbidden_moves, int *forbidden_moves);
 
 int simple_ladder(int str, int *move);
+void ladder_features(int color, signed char capture[BOARDMAX],
+		     signed char escape[BOARDMAX]);
 #define MOVE_ORDERING_PARAMETERS 67
 void tune_move_ordering(int params[MOVE_ORDERING_PARAMETERS]);
 void draw_reading_shadow(void);
@@ -507,6 +509,33 @@ void list_mc_patterns(void);
 void uct_genmove(int color, int *move, int *forbidden_moves,
 		 int *allowed_moves, int nodes, float *move_values,
 		 int *move_frequencies);
+int uct_ownership(float ownership[BOARDMAX]);
+
+/* Network evaluation and search results for a position, kept by
+ * genmove.c for as long as the position doesn't change.
+ */
+struct position_analysis {
+  int position_number;         /* position the results belong to */
+  int network;                 /* nn_network_generation() used */
+  int color;                   /* side to move */
+  int evaluated;               /* network evaluation available */
+  float value;                 /* network value for color, -1 to 1 */
+  float prior[BOARDMAX];       /* network policy */
+  signed char allowed[BOARDMAX]; /* find_allowed_moves() for color */
+  int searched;                /* search results available */
+  int simulations;             /* size of the search */
+  float komi;                  /* komi the search was scored with */
+  int total_visits;
+  int visits[BOARDMAX];        /* simulations through each move */
+  float win_rate[BOARDMAX];    /* win rate for color of each move */
+  int best_move;
+  int playouts;                /* final positions behind ownership */
+  float ownership[BOARDMAX];   /* 1 for black to -1 for white */
+};
+
+const struct position_analysis *analyze_position(int color, int search);
+const struct position_analysis *current_analysis(void);
+void clear_analysis(void);
 
 int owl_attack(int target, int *attack_point, int *certain, int *kworm);
 int owl_defend(int target, int *defense_point, int *certain, int *kworm);
@@ -0,0 +1,621 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Monte Carlo tree search, used for move generation with
+ * --monte-carlo.
+ *
+ * The search builds a tree of moves from the current position, played
+ * out on the board with trymove(). Each simulation walks down the
+ * tree, choosing at every node the child with the highest score
+ *
+ *   Q + UCT_EXPLORATION * P * sqrt(N) / (1 + n)
+ *
+ * where Q is the win rate of the child, P its prior probability, N
+ * the number of visits of the node and n those of the child. A leaf
+ * is expanded and evaluated the first time it is reached.
+ *
+ * When a network is loaded it gives the priors of the new children.
+ * If it also has a value head, its estimate of the outcome is mixed
+ * with the result of a random playout from the leaf as
+ *
+ *   nn_value_lambda * value + (1 - nn_value_lambda) * playout
+ *
+ * so that with nn_value_lambda = 1 a single network evaluation takes
+ * the place of the playout. Without network all moves get the same
+ * prior and leaves are evaluated by playouts alone.
+ *
+ * With nn_batch_size > 1 up to that many leaves are collected before
+ * the network evaluates them in one batch. Every node on the way to a
+ * collected leaf counts a visit right away, without a win, so that the
+ * following descents are steered elsewhere (a "virtual loss"). The
+ * results are added when the batch has been evaluated. A descent
+ * which reaches a leaf still waiting for its evaluation ends the
+ * batch early.
+ */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "liberty.h"
+#include "random.h"
+#include "nnmodel.h"
+
+/* Weight of the prior against the win rate when selecting moves. */
+#define UCT_EXPLORATION 1.0
+
+/* Win rate assumed for moves which have not been tried yet. */
+#define UCT_FIRST_PLAY_URGENCY 0.5
+
+struct uct_node {
+  int move;              /* move leading to this node */
+  int visits;
+  float wins;            /* sum of results, from 0 to 1, for the player
+			  * making move */
+  float prior;
+  int children;          /* index of the first child, -1 if the node has
+			  * not been expanded */
+  int num_children;
+  int parent;            /* -1 for the root */
+  int pending;           /* expanded, waiting for the network's priors */
+  int illegal;           /* move refused by trymove(), never selected */
+};
+
+/* A leaf collected for evaluation. */
+struct uct_leaf {
+  int node;
+  int color;             /* to move at the leaf */
+  int batch;             /* index from nn_batch_add(), -1 if none */
+  float result;          /* for color, without the network's value */
+};
+
+/* The tree. Children of a node are stored consecutively. The array is
+ * kept between searches and only grows.
+ */
+static struct uct_node *nodes = NULL;
+static int num_nodes = 0;
+static int max_nodes = 0;
+
+/* Owners of the points in the final positions of the last search,
+ * summed with 1 for black and -1 for white.
+ */
+static float ownership_sum[BOARDMAX];
+static int num_final_positions = 0;
+
+
+/* Reserve n consecutive nodes and return the index of the first. */
+static int
+new_nodes(int n)
+{
+  int first = num_nodes;
+
+  if (num_nodes + n > max_nodes) {
+    int size = gg_max(2 * max_nodes, num_nodes + n + 1024);
+    struct uct_node *p = realloc(nodes, size * sizeof(*nodes));
+    if (!p) {
+      perror("Couldn't allocate memory for Monte Carlo tree");
+      exit(EXIT_FAILURE);
+    }
+    nodes = p;
+    max_nodes = size;
+  }
+
+  num_nodes += n;
+  return first;
+}
+
+
+/* Area score of the current position, black minus white, with komi.
+ * An empty point belongs to a color when all its neighbors do. The
+ * owners are added to ownership_sum.
+ */
+static float
+area_score(void)
+{
+  float score = -komi;
+  int pos;
+  int k;
+
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
+    int owner = board[pos];
+
+    if (!ON_BOARD(pos))
+      continue;
+
+    if (owner == EMPTY) {
+      for (k = 0; k < 4; k++) {
+	int neighbor = board[pos + delta[k]];
+	if (neighbor == GRAY || neighbor == owner)
+	  continue;
+	if (owner != EMPTY) {
+	  owner = EMPTY;
+	  break;
+	}
+	owner = neighbor;
+      }
+    }
+
+    if (owner == BLACK) {
+      score += 1.0;
+      ownership_sum[pos] += 1.0;
+    }
+    else if (owner == WHITE) {
+      score -= 1.0;
+      ownership_sum[pos] -= 1.0;
+    }
+  }
+  num_final_positions++;
+
+  return score;
+}
+
+
+/* Result of the current position for color, 1 for a win, 0 for a
+ * loss and 0.5 for a draw.
+ */
+static float
+final_result(int color)
+{
+  float score = area_score();
+
+  if (score == 0.0)
+    return 0.5;
+  if ((score > 0.0) == (color == BLACK))
+    return 1.0;
+  return 0.0;
+}
+
+
+/* Play random moves, avoiding the players' own eyes, until both
+ * players pass or the move stack is nearly used up, and return the
+ * result for color, the player to move.
+ */
+static float
+playout(int color)
+{
+  int empty[BOARDMAX];
+  int num_empty;
+  int to_move = color;
+  int passes = 0;
+  int moves = 0;
+  float result;
+  int pos;
+
+  while (passes < 2 && stackp < MAXSTACK - 3) {
+    int move = PASS_MOVE;
+
+    num_empty = 0;
+    for (pos = BOARDMIN; pos < BOARD_LAST; pos++)
+      if (board[pos] == EMPTY)
+	empty[num_empty++] = pos;
+
+    while (num_empty > 0) {
+      int k = gg_urand() % num_empty;
+      int candidate = empty[k];
+      empty[k] = empty[--num_empty];
+      if (!is_own_eye(candidate, to_move)
+	  && trymove(candidate, to_move, "playout", NO_MOVE)) {
+	move = candidate;
+	break;
+      }
+    }
+
+    if (move == PASS_MOVE) {
+      if (!trymove(PASS_MOVE, to_move, "playout", NO_MOVE))
+	break;
+      passes++;
+    }
+    else
+      passes = 0;
+
+    moves++;
+    to_move = OTHER_COLOR(to_move);
+  }
+
+  result = final_result(color);
+  while (moves-- > 0)
+    popgo();
+
+  return result;
+}
+
+
+/* Create the children of node, the moves of color in the current
+ * position, with the same prior for all of them. At the root the
+ * moves are restricted by find_allowed_moves() and the optional
+ * forbidden_moves and allowed_moves arrays.
+ */
+static void
+add_children(int node, int color, int root, int *forbidden_moves,
+	     int *allowed_moves)
+{
+  signed char allowed[BOARDMAX];
+  int moves[BOARDMAX];
+  int num_moves = 0;
+  int first;
+  int pos;
+  int k;
+
+  if (root)
+    find_allowed_moves(color, allowed, 1);
+
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
+    if (root) {
+      if (!allowed[pos]
+	  || (forbidden_moves && forbidden_moves[pos])
+	  || (allowed_moves && !allowed_moves[pos]))
+	continue;
+    }
+    else if (board[pos] != EMPTY || is_own_eye(pos, color)
+	     || !is_legal(pos, color))
+      continue;
+    moves[num_moves++] = pos;
+  }
+
+  /* Passing is only considered when there is nothing else to do. */
+  if (num_moves == 0)
+    moves[num_moves++] = PASS_MOVE;
+
+  first = new_nodes(num_moves);
+  for (k = 0; k < num_moves; k++) {
+    struct uct_node *child = &nodes[first + k];
+    child->move = moves[k];
+    child->visits = 0;
+    child->wins = 0.0;
+    child->prior = 1.0 / num_moves;
+    child->children = -1;
+    child->num_children = 0;
+    child->parent = node;
+    child->pending = 0;
+    child->illegal = 0;
+  }
+  nodes[node].children = first;
+  nodes[node].num_children = num_moves;
+}
+
+
+/* Weight of the network's value in the result of a leaf. */
+static float
+value_weight(int have_policy)
+{
+  if (have_policy && nn_have_value_head())
+    return gg_min(1.0, gg_max(0.0, nn_value_lambda));
+  return 0.0;
+}
+
+
+/* Expand the leaf node, where color is to move, queue it for
+ * evaluation by the network and run the playout, if its result is
+ * needed. The priors and the value are filled in by finish_leaf()
+ * after nn_batch_evaluate().
+ */
+static void
+start_leaf(struct uct_leaf *leaf, int node, int color, int root,
+	   int *forbidden_moves, int *allowed_moves)
+{
+  leaf->node = node;
+  leaf->color = color;
+  leaf->batch = nn_batch_add(color);
+  add_children(node, color, root, forbidden_moves, allowed_moves);
+  nodes[node].pending = (leaf->batch >= 0);
+
+  leaf->result = 0.0;
+  if (value_weight(leaf->batch >= 0) < 1.0)
+    leaf->result = playout(color);
+}
+
+
+/* Set the priors of the children of an evaluated leaf and return its
+ * estimated result for the player to move.
+ */
+static float
+finish_leaf(const struct uct_leaf *leaf)
+{
+  struct uct_node *node = &nodes[leaf->node];
+  float policy[BOARDMAX];
+  float value = 0.0;
+  float lambda = value_weight(leaf->batch >= 0);
+  float result;
+  float sum = 0.0;
+  int k;
+
+  if (leaf->batch >= 0) {
+    nn_batch_result(leaf->batch, policy, &value);
+    for (k = 0; k < node->num_children; k++)
+      if (nodes[node->children + k].move != PASS_MOVE)
+	sum += policy[nodes[node->children + k].move];
+    if (sum > 0.0)
+      for (k = 0; k < node->num_children; k++) {
+	struct uct_node *child = &nodes[node->children + k];
+	if (child->move != PASS_MOVE)
+	  child->prior = policy[child->move] / sum;
+      }
+    node->pending = 0;
+  }
+
+  result = 0.0;
+  if (lambda < 1.0)
+    result += (1.0 - lambda) * leaf->result;
+  if (lambda > 0.0)
+    result += lambda * (value + 1.0) / 2.0;
+
+  return result;
+}
+
+
+/* Choose the child of node to explore next. Returns -1 if all
+ * children are illegal.
+ */
+static int
+select_child(int node)
+{
+  const struct uct_node *parent = &nodes[node];
+  float sqrt_visits = sqrt((float) parent->visits);
+  float best_score = -1.0;
+  int best = -1;
+  int k;
+
+  for (k = 0; k < parent->num_children; k++) {
+    const struct uct_node *child = &nodes[parent->children + k];
+    float q = UCT_FIRST_PLAY_URGENCY;
+    float score;
+
+    if (child->illegal)
+      continue;
+    if (child->visits > 0)
+      q = child->wins / child->visits;
+    score = q + UCT_EXPLORATION * child->prior * sqrt_visits
+      / (1 + child->visits);
+    if (score > best_score) {
+      best_score = score;
+      best = parent->children + k;
+    }
+  }
+
+  return best;
+}
+
+
+/* The move of child, a child of node, has been refused by trymove().
+ * Expansion only creates legal moves, but a move can still fail, e.g.
+ * when the board runs out of room for string data deep in the tree.
+ * The child is left out of the selection from now on. When no legal
+ * child remains, passing takes its place.
+ */
+static void
+remove_child(int node, int child)
+{
+  nodes[child].illegal = 1;
+  nodes[child].prior = 0.0;
+
+  if (select_child(node) < 0) {
+    nodes[child].move = PASS_MOVE;
+    nodes[child].illegal = 0;
+    nodes[child].prior = 1.0;
+    nodes[child].children = -1;
+    nodes[child].num_children = 0;
+  }
+}
+
+
+/* Walk down the tree from the root, where color is to move, counting
+ * a visit to every node on the way, and prepare the leaf which is
+ * reached. Returns 0, with the visits taken back, if the descent ends
+ * at a leaf which is still waiting for the network.
+ */
+static int
+descend(int color, struct uct_leaf *leaf)
+{
+  int node = 0;
+  int to_move = color;
+  int passes = 0;
+  int depth = 0;
+  int k;
+
+  while (nodes[node].children >= 0 && passes < 2) {
+    int child;
+
+    if (nodes[node].pending) {
+      for (k = nodes[node].parent; k >= 0; k = nodes[k].parent)
+	nodes[k].visits--;
+      while (depth-- > 0)
+	popgo();
+      return 0;
+    }
+
+    child = select_child(node);
+    if (stackp >= MAXSTACK - 3)
+      break;
+    if (!trymove(nodes[child].move, to_move, "uct", NO_MOVE)) {
+      /* Passing only fails when the board is out of room. */
+      if (nodes[child].move == PASS_MOVE)
+	break;
+      remove_child(node, child);
+      continue;
+    }
+    nodes[node].visits++;
+    depth++;
+    passes = (nodes[child].move == PASS_MOVE ? passes + 1 : 0);
+    to_move = OTHER_COLOR(to_move);
+    node = child;
+  }
+  nodes[node].visits++;
+
+  leaf->node = node;
+  leaf->color = to_move;
+  leaf->batch = -1;
+  if (passes >= 2)
+    leaf->result = final_result(to_move);
+  else if (nodes[node].children < 0)
+    start_leaf(leaf, node, to_move, 0, NULL, NULL);
+  else {
+    /* Out of room on the move stack. */
+    leaf->result = 0.5;
+  }
+
+  while (depth-- > 0)
+    popgo();
+  return 1;
+}
+
+
+/* Add the result of an evaluated leaf to the nodes above it. Their
+ * visits were already counted by descend().
+ */
+static void
+backup(const struct uct_leaf *leaf)
+{
+  float result;
+  int odd = 0;
+  int node;
+
+  if (leaf->batch >= 0)
+    result = finish_leaf(leaf);
+  else
+    result = leaf->result;
+
+  /* The move into a node was made by the player to move at the leaf
+   * if the node is an odd number of steps above the leaf.
+   */
+  for (node = leaf->node; node >= 0; node = nodes[node].parent) {
+    if (odd)
+      nodes[node].wins += result;
+    else
+      nodes[node].wins += 1.0 - result;
+    odd = !odd;
+  }
+}
+
+
+/* Generate a move for color by Monte Carlo tree search with the given
+ * number of simulations. forbidden_moves and allowed_moves, unless
+ * NULL, restrict the moves considered. If move_values is not NULL it
+ * receives the win rate of each move tried and move_frequencies the
+ * number of simulations through it.
+ */
+void
+uct_genmove(int color, int *move, int *forbidden_moves, int *allowed_moves,
+	    int nodes_to_search, float *move_values, int *move_frequencies)
+{
+  const struct uct_node *root;
+  struct uct_leaf leaves[NN_MAX_BATCH];
+  int max_leaves;
+  int num_leaves;
+  int best = -1;
+  int k;
+  int j;
+
+  num_nodes = 0;
+  num_final_positions = 0;
+  for (k = 0; k < BOARDMAX; k++)
+    ownership_sum[k] = 0.0;
+  new_nodes(1);
+  nodes[0].move = NO_MOVE;
+  nodes[0].visits = 0;
+  nodes[0].wins = 0.0;
+  nodes[0].prior = 1.0;
+  nodes[0].children = -1;
+  nodes[0].num_children = 0;
+  nodes[0].parent = -1;
+  nodes[0].pending = 0;
+  nodes[0].illegal = 0;
+
+  max_leaves = nn_batch_capacity();
+  start_leaf(&leaves[0], 0, color, 1, forbidden_moves, allowed_moves);
+  nn_batch_evaluate();
+  finish_leaf(&leaves[0]);
+  nodes[0].visits = 1;
+
+  for (k = 0; k < nodes_to_search; k += num_leaves) {
+    num_leaves = 0;
+    while (num_leaves < gg_min(max_leaves, nodes_to_search - k)
+	   && descend(color, &leaves[num_leaves]))
+      num_leaves++;
+    nn_batch_evaluate();
+    for (j = 0; j < num_leaves; j++)
+      backup(&leaves[j]);
+  }
+
+  if (move_values)
+    for (k = 0; k < BOARDMAX; k++)
+      move_values[k] = 0.0;
+  if (move_frequencies)
+    for (k = 0; k < BOARDMAX; k++)
+      move_frequencies[k] = 0;
+
+  root = &nodes[0];
+  for (k = 0; k < root->num_children; k++) {
+    const struct uct_node *child = &nodes[root->children + k];
+
+    if (child->illegal)
+      continue;
+    if (best < 0
+	|| child->visits > nodes[best].visits
+	|| (child->visits == nodes[best].visits
+	    && child->prior > nodes[best].prior))
+      best = root->children + k;
+
+    if (child->visits > 0) {
+      if (move_values)
+	move_values[child->move] = child->wins / child->visits;
+      if (move_frequencies)
+	move_frequencies[child->move] = child->visits;
+    }
+
+    if (verbose && child->visits > 0)
+      gprintf("%1m: %d visits, win rate %f, prior %f\n", child->move,
+	      child->visits, child->wins / child->visits, child->prior);
+  }
+
+  *move = nodes[best].move;
+}
+
+
+/* Average owner of each point at the end of the playouts of the last
+ * search, from 1 for black to -1 for white. Returns the number of
+ * final positions this is based on, 0 if leaves were evaluated by the
+ * network alone.
+ */
+int
+uct_ownership(float ownership[BOARDMAX])
+{
+  int pos;
+
+  for (pos = 0; pos < BOARDMAX; pos++)
+    if (num_final_positions > 0)
+      ownership[pos] = ownership_sum[pos] / num_final_positions;
+    else
+      ownership[pos] = 0.0;
+
+  return num_final_positions;
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,356 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Check that network evaluations do not allocate memory.
+ *
+ * Usage: nnalloc [evaluations]
+ *
+ * The program is linked with -Wl,--wrap=malloc,--wrap=calloc,
+ * --wrap=realloc, so that every allocation passes through the
+ * counting wrappers below. It writes a small network with a value
+ * head, half precision weights, a batch normalisation layer and the
+ * ladder feature planes to nnalloc.dgnn in the current directory,
+ * and loads it. Positions are taken from random games on a 19x19
+ * board. Each kind of evaluation is run once to let the engine set up
+ * its arenas, cache and threads. Then the given number of
+ * evaluations, 100 by default, is run with each symmetry setting,
+ * with nn_evaluate() and with batches of nn_batch_add(). The program
+ * fails if any of these allocates memory.
+ */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liberty.h"
+#include "nnmodel.h"
+#include "random.h"
+
+#define TEST_FILE    "nnalloc.dgnn"
+#define TEST_SIZE    19
+#define TEST_PLANES  16
+#define TEST_BATCH   8
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+static int counting = 0;
+static unsigned long allocations = 0;
+
+void *
+__wrap_malloc(size_t size)
+{
+  if (counting)
+    allocations++;
+  return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t count, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __real_calloc(count, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __real_realloc(ptr, size);
+}
+
+
+struct test_layer {
+  int type;
+  int activation;
+  int input;
+  int in_planes;
+  int out_planes;
+  int kernel;
+  int format;
+};
+
+/* The policy is computed by the last layer, the value by layer
+ * TEST_VALUE_LAYER from the features of layer 4.
+ */
+static const struct test_layer test_layers[] = {
+  {NN_LAYER_CONV, NN_ACT_NONE, -1, NN_KGSGO_LADDER_PLANES, TEST_PLANES, 3,
+   NN_WEIGHTS_FLOAT16},
+  {NN_LAYER_ACTIVATION, NN_ACT_RELU, 0, TEST_PLANES, TEST_PLANES, 0,
+   NN_WEIGHTS_FLOAT32},
+  {NN_LAYER_CONV, NN_ACT_NONE, 1, TEST_PLANES, TEST_PLANES, 3,
+   NN_WEIGHTS_FLOAT32},
+  {NN_LAYER_BN, NN_ACT_NONE, 2, TEST_PLANES, TEST_PLANES, 0,
+   NN_WEIGHTS_FLOAT32},
+  {NN_LAYER_ACTIVATION, NN_ACT_RELU, 3, TEST_PLANES, TEST_PLANES, 0,
+   NN_WEIGHTS_FLOAT32},
+  {NN_LAYER_FC, NN_ACT_NONE, 4, TEST_PLANES, 1, 0, NN_WEIGHTS_FLOAT32},
+  {NN_LAYER_ACTIVATION, NN_ACT_TANH, 5, 1, 1, 0, NN_WEIGHTS_FLOAT32},
+  {NN_LAYER_CONV, NN_ACT_NONE, 4, TEST_PLANES, 1, 1, NN_WEIGHTS_FLOAT32},
+  {NN_LAYER_SOFTMAX, NN_ACT_NONE, 7, 1, 1, 0, NN_WEIGHTS_FLOAT32}
+};
+
+#define TEST_LAYERS (int) (sizeof(test_layers) / sizeof(test_layers[0]))
+#define TEST_VALUE_LAYER 6
+
+
+/* Small pseudo random weight, the same on every run. */
+static float
+test_weight(unsigned int k)
+{
+  return ((k * 2654435761U) % 2001 - 1000.0) / 10000.0;
+}
+
+
+/* Write the test network to filename. Returns 0 on failure. */
+static int
+write_test_network(const char *filename)
+{
+  struct nn_file_header header;
+  struct nn_layer_desc descs[TEST_LAYERS];
+  char *data;
+  size_t offset;
+  unsigned int n = 0;
+  int points = TEST_SIZE * TEST_SIZE;
+  int k;
+  unsigned int i;
+  FILE *f;
+
+  memset(descs, 0, sizeof(descs));
+  offset = NN_ALIGN_UP(sizeof(header) + sizeof(descs));
+  for (k = 0; k < TEST_LAYERS; k++) {
+    const struct test_layer *t = &test_layers[k];
+    struct nn_layer_desc *d = &descs[k];
+    d->type = t->type;
+    d->activation = t->activation;
+    d->input = t->input;
+    d->in_planes = t->in_planes;
+    d->out_planes = t->out_planes;
+    d->kernel = t->kernel;
+    d->weights_format = t->format;
+    if (t->type == NN_LAYER_CONV) {
+      d->weights_count = t->out_planes * t->in_planes * t->kernel * t->kernel;
+      d->bias_count = t->out_planes;
+    }
+    else if (t->type == NN_LAYER_FC) {
+      d->weights_count = t->out_planes * t->in_planes * points;
+      d->bias_count = t->out_planes;
+    }
+    else if (t->type == NN_LAYER_BN)
+      d->weights_count = 4 * t->out_planes;
+
+    if (d->weights_count > 0) {
+      d->weights_offset = offset;
+      offset = NN_ALIGN_UP(offset + d->weights_count
+			   * (t->format == NN_WEIGHTS_FLOAT16
+			      ? sizeof(unsigned short) : sizeof(float)));
+    }
+    if (d->bias_count > 0) {
+      d->bias_offset = offset;
+      offset = NN_ALIGN_UP(offset + d->bias_count * sizeof(float));
+    }
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NN_MODEL_MAGIC, 4);
+  header.version = NN_MODEL_VERSION;
+  header.byte_order = NN_MODEL_BYTE_ORDER;
+  header.header_size = sizeof(header);
+  header.layer_desc_size = sizeof(struct nn_layer_desc);
+  header.num_layers = TEST_LAYERS;
+  header.feature_set = NN_FEATURES_KGSGO_LADDER;
+  header.input_planes = NN_KGSGO_LADDER_PLANES;
+  header.board_size = TEST_SIZE;
+  header.file_size = offset;
+  header.value_layer = TEST_VALUE_LAYER;
+
+  data = calloc(offset, 1);
+  if (!data) {
+    perror("Couldn't allocate memory for test network");
+    return 0;
+  }
+  memcpy(data, &header, sizeof(header));
+  memcpy(data + sizeof(header), descs, sizeof(descs));
+
+  for (k = 0; k < TEST_LAYERS; k++) {
+    const struct nn_layer_desc *d = &descs[k];
+    for (i = 0; i < d->weights_count; i++) {
+      float w = test_weight(n++);
+      if (d->type == NN_LAYER_BN && i >= 3 * (unsigned int) d->out_planes)
+	w = 1.0 + gg_abs(w);   /* variance */
+      if (d->weights_format == NN_WEIGHTS_FLOAT16)
+	((unsigned short *) (data + d->weights_offset))[i]
+	  = nn_float_to_half(w);
+      else
+	((float *) (data + d->weights_offset))[i] = w;
+    }
+    for (i = 0; i < d->bias_count; i++)
+      ((float *) (data + d->bias_offset))[i] = test_weight(n++);
+  }
+
+  f = fopen(filename, "wb");
+  if (!f || fwrite(data, 1, offset, f) != offset || fclose(f) != 0) {
+    perror(filename);
+    free(data);
+    return 0;
+  }
+  free(data);
+
+  return 1;
+}
+
+
+/* Play a random move, other than filling an own eye, for color. When
+ * there is none, or the game has gone on long enough, start over on
+ * an empty board.
+ */
+static void
+random_move(int color)
+{
+  int moves[BOARDMAX];
+  int num_moves = 0;
+  int pos;
+
+  if (movenum < 250)
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+      if (board[pos] == EMPTY && !is_own_eye(pos, color)
+	  && is_legal(pos, color))
+	moves[num_moves++] = pos;
+
+  if (num_moves == 0)
+    gnugo_clear_board(TEST_SIZE);
+  else
+    gnugo_play_move(moves[gg_urand() % num_moves], color);
+}
+
+
+/* Run evaluations of positions from random games with nn_evaluate(),
+ * or in batches with nn_batch_add() if batch is larger than 1. Only
+ * the evaluations are counted.
+ */
+static void
+run_evaluations(int evaluations, int batch)
+{
+  float policy[BOARDMAX];
+  float value;
+  int color = BLACK;
+  int done = 0;
+  int k;
+
+  while (done < evaluations) {
+    random_move(color);
+    color = OTHER_COLOR(color);
+
+    if (batch <= 1) {
+      counting = 1;
+      nn_evaluate(color, policy, &value);
+      counting = 0;
+      done++;
+      continue;
+    }
+
+    /* A batch of the positions after each of a few replies. */
+    for (k = 0; k < batch && done < evaluations; k++) {
+      int pos = BOARDMIN + gg_urand() % (BOARDMAX - BOARDMIN);
+      if (board[pos] == EMPTY && trymove(pos, color, "nnalloc", NO_MOVE)) {
+	counting = 1;
+	nn_batch_add(OTHER_COLOR(color));
+	counting = 0;
+	popgo();
+      }
+      else {
+	counting = 1;
+	nn_batch_add(color);
+	counting = 0;
+      }
+      done++;
+    }
+    counting = 1;
+    nn_batch_evaluate();
+    nn_batch_result(0, policy, &value);
+    counting = 0;
+  }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  static const int modes[3] = {NN_SYMMETRY_NONE, NN_SYMMETRY_RANDOM,
+			       NN_SYMMETRY_FULL};
+  static const char *mode_names[3] = {"none", "random", "full"};
+  int evaluations = 100;
+  int failures = 0;
+  int m;
+  int batch;
+
+  if (argc > 1)
+    evaluations = atoi(argv[1]);
+
+  init_gnugo(DEFAULT_MEMORY, 1);
+  gnugo_clear_board(TEST_SIZE);
+
+  /* Also split the layers over the thread pool. */
+  nn_threads = 2;
+
+  if (!write_test_network(TEST_FILE))
+    return EXIT_FAILURE;
+  if (!nn_load_network(TEST_FILE)) {
+    remove(TEST_FILE);
+    return EXIT_FAILURE;
+  }
+
+  for (m = 0; m < 3; m++) {
+    nn_set_symmetry(modes[m]);
+    for (batch = 1; batch <= TEST_BATCH; batch += TEST_BATCH - 1) {
+      nn_batch_size = batch;
+      run_evaluations(1, nn_batch_capacity());
+
+      allocations = 0;
+      run_evaluations(evaluations, nn_batch_capacity());
+      printf("symmetry %s, batch %d: %d evaluations, %lu allocations\n",
+	     mode_names[m], batch, evaluations, allocations);
+      if (allocations > 0)
+	failures++;
+    }
+  }
+
+  remove(TEST_FILE);
+  return (failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
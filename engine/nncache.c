@@ -0,0 +1,248 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liberty.h"
+#include "nncache.h"
+#include "gg_thread.h"
+
+
+/* Number of entries used when no size is given. At about 1.5 kB per
+ * entry this is 6 MB.
+ */
+#define DEFAULT_NN_CACHE_ENTRIES 4096
+
+/* The table is protected by a fixed number of locks, each covering
+ * every NN_CACHE_STRIPES'th entry, so that threads evaluating
+ * different positions rarely wait for each other.
+ */
+#define NN_CACHE_STRIPES 64
+
+struct nn_cache_entry {
+  Hash_data key;
+  int color;                 /* EMPTY for an unused entry */
+  int size;                  /* board size */
+  float policy[MAX_BOARD * MAX_BOARD];
+  float value;               /* 0.0 if the network has no value head */
+};
+
+struct nn_cache_stripe {
+  gg_mutex_t lock;
+  struct nn_cache_stats stats;
+};
+
+static struct nn_cache_entry *entries = NULL;
+static int num_entries = 0;
+static struct nn_cache_stripe stripes[NN_CACHE_STRIPES];
+
+
+/* Allocate the cache, using at most the given number of bytes.
+ * Negative means the default size, zero disables the cache.
+ */
+void
+nn_cache_init(int bytes)
+{
+  static int locks_initialized = 0;
+  int k;
+
+  if (!locks_initialized) {
+    for (k = 0; k < NN_CACHE_STRIPES; k++)
+      gg_mutex_init(&stripes[k].lock);
+    locks_initialized = 1;
+  }
+
+  free(entries);
+  entries = NULL;
+
+  if (bytes < 0)
+    num_entries = DEFAULT_NN_CACHE_ENTRIES;
+  else
+    num_entries = bytes / sizeof(struct nn_cache_entry);
+
+  if (num_entries > 0) {
+    entries = malloc(num_entries * sizeof(struct nn_cache_entry));
+    if (entries == NULL) {
+      perror("Couldn't allocate memory for network cache. \n");
+      exit(1);
+    }
+  }
+
+  nn_cache_clear();
+}
+
+
+/* Invalidate all entries. The statistics are kept. All stripes are
+ * locked, always in the same order, so that no lookup or store can
+ * run meanwhile.
+ */
+void
+nn_cache_clear(void)
+{
+  int k;
+
+  for (k = 0; k < NN_CACHE_STRIPES; k++)
+    gg_mutex_lock(&stripes[k].lock);
+  for (k = 0; k < num_entries; k++)
+    entries[k].color = EMPTY;
+  for (k = NN_CACHE_STRIPES - 1; k >= 0; k--)
+    gg_mutex_unlock(&stripes[k].lock);
+}
+
+
+/* Compute the cache key for the current position with color to move. */
+void
+nn_cache_make_key(int color, struct nn_cache_key *key)
+{
+  key->color = color;
+  if (nn_cache_invariant)
+    key->rotation = hashdata_calc_orientation_invariant(&key->hash, board,
+							board_ko_pos);
+  else {
+    key->hash = board_hash;
+    key->rotation = 0;
+  }
+}
+
+
+static int
+entry_index(const struct nn_cache_key *key)
+{
+  return (hashdata_remainder(key->hash, num_entries) + key->color)
+	 % num_entries;
+}
+
+
+/* Look up the current position. On a hit the policy is copied to
+ * policy[], rotated back to the current orientation, the value to
+ * *value unless it is NULL, and 1 is returned.
+ */
+int
+nn_cache_lookup(const struct nn_cache_key *key, float policy[BOARDMAX],
+		float *value)
+{
+  struct nn_cache_entry *entry;
+  struct nn_cache_stripe *stripe;
+  int index;
+  int found;
+  int pos;
+
+  if (num_entries == 0)
+    return 0;
+
+  index = entry_index(key);
+  entry = &entries[index];
+  stripe = &stripes[index % NN_CACHE_STRIPES];
+
+  gg_mutex_lock(&stripe->lock);
+  stripe->stats.lookups++;
+  found = (entry->color == key->color
+	   && entry->size == board_size
+	   && hashdata_is_equal(entry->key, key->hash));
+  if (found) {
+    stripe->stats.hits++;
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+      if (ON_BOARD(pos)) {
+	int rpos = rotate1(pos, key->rotation);
+	policy[pos] = entry->policy[I(rpos) * board_size + J(rpos)];
+      }
+      else
+	policy[pos] = 0.0;
+    }
+    if (value)
+      *value = entry->value;
+  }
+  gg_mutex_unlock(&stripe->lock);
+
+  return found;
+}
+
+
+/* Store the policy and value for the current position, replacing
+ * whatever was in the slot.
+ */
+void
+nn_cache_store(const struct nn_cache_key *key, const float policy[BOARDMAX],
+	       float value)
+{
+  struct nn_cache_entry *entry;
+  struct nn_cache_stripe *stripe;
+  int index;
+  int pos;
+
+  if (num_entries == 0)
+    return;
+
+  index = entry_index(key);
+  entry = &entries[index];
+  stripe = &stripes[index % NN_CACHE_STRIPES];
+
+  gg_mutex_lock(&stripe->lock);
+  stripe->stats.stores++;
+  entry->key = key->hash;
+  entry->color = key->color;
+  entry->size = board_size;
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+    if (ON_BOARD(pos)) {
+      int rpos = rotate1(pos, key->rotation);
+      entry->policy[I(rpos) * board_size + J(rpos)] = policy[pos];
+    }
+  entry->value = value;
+  gg_mutex_unlock(&stripe->lock);
+}
+
+
+/* Sum up the statistics of all stripes. */
+void
+nn_cache_get_stats(struct nn_cache_stats *stats)
+{
+  int k;
+
+  memset(stats, 0, sizeof(*stats));
+  for (k = 0; k < NN_CACHE_STRIPES; k++) {
+    gg_mutex_lock(&stripes[k].lock);
+    stats->lookups += stripes[k].stats.lookups;
+    stats->hits += stripes[k].stats.hits;
+    stats->stores += stripes[k].stats.stores;
+    gg_mutex_unlock(&stripes[k].lock);
+  }
+}
+
+
+int
+nn_cache_num_entries(void)
+{
+  return num_entries;
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
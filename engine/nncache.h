@@ -0,0 +1,70 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _NNCACHE_H_
+#define _NNCACHE_H_
+
+#include "hash.h"
+
+/*
+ * Cache for network evaluations, see nncache.c.
+ *
+ * Positions are identified by board_hash, the board size and the color
+ * to move. With nn_cache_invariant set, the orientation invariant hash
+ * is used instead, so that rotated and mirrored positions share an
+ * entry. The policy is then stored in the canonical orientation and
+ * rotated back on lookup.
+ */
+
+struct nn_cache_key {
+  Hash_data hash;
+  int color;
+  int rotation;     /* maps the current board to the stored orientation */
+};
+
+struct nn_cache_stats {
+  unsigned long lookups;
+  unsigned long hits;
+  unsigned long stores;
+};
+
+void nn_cache_init(int bytes);
+void nn_cache_clear(void);
+void nn_cache_make_key(int color, struct nn_cache_key *key);
+int nn_cache_lookup(const struct nn_cache_key *key, float policy[BOARDMAX],
+		    float *value);
+void nn_cache_store(const struct nn_cache_key *key,
+		    const float policy[BOARDMAX], float value);
+void nn_cache_get_stats(struct nn_cache_stats *stats);
+int nn_cache_num_entries(void);
+
+
+#endif  /* _NNCACHE_H_ */
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
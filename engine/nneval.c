@@ -0,0 +1,1135 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "liberty.h"
+#include "random.h"
+#include "gg_utils.h"
+#include "nnmodel.h"
+#include "nncache.h"
+#include "gg_thread.h"
+
+
+/* The network used by the engine, or NULL if none has been loaded. */
+static struct nn_model *network = NULL;
+
+/* Wall clock time spent in each layer of the network, collected while
+ * profiling is enabled.
+ */
+static double *layer_seconds = NULL;
+
+/* Arena used by nn_batch_evaluate(), large enough for the 8
+ * orientations of full symmetry. Allocated together with the network
+ * and enlarged by nn_batch_capacity() for batches of nn_batch_size
+ * positions.
+ */
+static struct nn_arena *eval_arena = NULL;
+
+/* A position queued with nn_batch_add(). Its samples, one per
+ * orientation, are stored consecutively in eval_arena.
+ */
+struct batch_entry {
+  struct nn_cache_key key;
+  int cached;             /* found in the cache, nothing to evaluate */
+  int first;              /* first sample in eval_arena */
+  int samples;
+  int rot[8];
+  float policy[BOARDMAX];
+  float value;
+};
+
+/* The current batch. Once it has been evaluated the results stay
+ * available until the next call to nn_batch_add().
+ */
+static struct batch_entry batch[NN_MAX_BATCH];
+static int batch_positions = 0;
+static int batch_samples = 0;
+static int batch_n = 0;         /* width the network is run at */
+static int batch_evaluated = 0;
+static struct nn_batch_stats batch_stats;
+
+
+/* Incremented whenever a network is installed, so that results
+ * computed with an earlier network can be recognized.
+ */
+static int network_generation = 0;
+
+/* State of the last background reload, see nn_start_reload(). */
+static struct nn_reload_status reload_status;
+static struct nn_model *reload_model = NULL;
+static struct nn_arena *reload_arena = NULL;
+
+
+/* Load a network file and allocate an arena for it. Returns 0, after
+ * printing a message to stderr, on failure.
+ */
+static int
+prepare_network(const char *filename, struct nn_model **model,
+		struct nn_arena **arena)
+{
+  *model = nn_model_load(filename);
+  if (!*model)
+    return 0;
+
+  *arena = nn_arena_new(*model, 8);
+  if (!*arena) {
+    fprintf(stderr, "%s: not enough memory to run the network\n", filename);
+    nn_model_free(*model);
+    *model = NULL;
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/* Replace the current network. Evaluations cached for the old one are
+ * dropped.
+ */
+static void
+install_network(struct nn_model *model, struct nn_arena *arena)
+{
+  nn_arena_free(eval_arena);
+  nn_model_free(network);
+  network = model;
+  eval_arena = arena;
+  batch_positions = 0;
+  batch_samples = 0;
+  batch_evaluated = 0;
+  network_generation++;
+  nn_cache_clear();
+  if (layer_seconds)
+    nn_set_profiling(1);
+}
+
+
+/* Load the network to be used for move evaluation, replacing any
+ * previously loaded one. Returns 1 on success, 0 if the file could
+ * not be loaded, in which case the old network is kept.
+ */
+int
+nn_load_network(const char *filename)
+{
+  struct nn_model *model;
+  struct nn_arena *arena;
+
+  if (!prepare_network(filename, &model, &arena))
+    return 0;
+
+  install_network(model, arena);
+  return 1;
+}
+
+
+/* Number of networks installed so far. */
+int
+nn_network_generation(void)
+{
+  return network_generation;
+}
+
+
+#if HAVE_PTHREAD
+
+static pthread_mutex_t reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t reload_thread;
+static int reload_thread_started = 0;
+
+static void *
+reload_loop(void *arg)
+{
+  struct nn_model *model;
+  struct nn_arena *arena;
+  double start = gg_gettimeofday();
+  int ok;
+  UNUSED(arg);
+
+  ok = prepare_network(reload_status.filename, &model, &arena);
+
+  pthread_mutex_lock(&reload_lock);
+  reload_status.load_seconds = gg_gettimeofday() - start;
+  if (ok) {
+    reload_model = model;
+    reload_arena = arena;
+    reload_status.state = NN_RELOAD_READY;
+  }
+  else
+    reload_status.state = NN_RELOAD_FAILED;
+  pthread_mutex_unlock(&reload_lock);
+
+  return NULL;
+}
+
+#endif
+
+
+/* Start loading a network file in the background, while the engine
+ * keeps using the current network. The new network replaces the old
+ * one at the next call to nn_swap_network(). Returns 0 if a reload is
+ * already in progress or the file name is too long.
+ */
+int
+nn_start_reload(const char *filename)
+{
+  if (strlen(filename) >= sizeof(reload_status.filename))
+    return 0;
+
+#if HAVE_PTHREAD
+  pthread_mutex_lock(&reload_lock);
+  if (reload_status.state == NN_RELOAD_LOADING
+      || reload_status.state == NN_RELOAD_READY) {
+    pthread_mutex_unlock(&reload_lock);
+    return 0;
+  }
+  if (reload_thread_started) {
+    pthread_join(reload_thread, NULL);
+    reload_thread_started = 0;
+  }
+
+  strcpy(reload_status.filename, filename);
+  reload_status.state = NN_RELOAD_LOADING;
+  reload_status.load_seconds = 0.0;
+  reload_status.swap_seconds = 0.0;
+  if (pthread_create(&reload_thread, NULL, reload_loop, NULL) != 0) {
+    /* Load in this thread instead. */
+    pthread_mutex_unlock(&reload_lock);
+    reload_loop(NULL);
+    return 1;
+  }
+  reload_thread_started = 1;
+  pthread_mutex_unlock(&reload_lock);
+  return 1;
+
+#else
+  /* Without threads the network is loaded right away, but it is still
+   * only swapped in by nn_swap_network().
+   */
+  {
+    double start = gg_gettimeofday();
+    if (reload_status.state == NN_RELOAD_READY)
+      return 0;
+    strcpy(reload_status.filename, filename);
+    reload_status.swap_seconds = 0.0;
+    if (prepare_network(filename, &reload_model, &reload_arena))
+      reload_status.state = NN_RELOAD_READY;
+    else
+      reload_status.state = NN_RELOAD_FAILED;
+    reload_status.load_seconds = gg_gettimeofday() - start;
+    return 1;
+  }
+#endif
+}
+
+
+/* Install a network loaded by nn_start_reload() if it is ready. This
+ * must only be called between searches, when no evaluations are in
+ * progress. Returns 1 if the network was replaced.
+ */
+int
+nn_swap_network(void)
+{
+  double start;
+
+#if HAVE_PTHREAD
+  pthread_mutex_lock(&reload_lock);
+#endif
+  if (reload_status.state != NN_RELOAD_READY) {
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&reload_lock);
+#endif
+    return 0;
+  }
+
+  start = gg_gettimeofday();
+  install_network(reload_model, reload_arena);
+  reload_model = NULL;
+  reload_arena = NULL;
+  reload_status.swap_seconds = gg_gettimeofday() - start;
+  reload_status.state = NN_RELOAD_DONE;
+#if HAVE_PTHREAD
+  pthread_mutex_unlock(&reload_lock);
+#endif
+
+  return 1;
+}
+
+
+void
+nn_get_reload_status(struct nn_reload_status *status)
+{
+#if HAVE_PTHREAD
+  pthread_mutex_lock(&reload_lock);
+#endif
+  *status = reload_status;
+#if HAVE_PTHREAD
+  pthread_mutex_unlock(&reload_lock);
+#endif
+}
+
+
+const struct nn_model *
+nn_current_network(void)
+{
+  return network;
+}
+
+
+/* Start collecting per layer timings, clearing earlier ones, or stop.
+ * Profiling is meant for benchmarks and is not thread safe.
+ */
+void
+nn_set_profiling(int enable)
+{
+  free(layer_seconds);
+  layer_seconds = NULL;
+  if (enable && network)
+    layer_seconds = calloc(network->num_layers, sizeof(double));
+}
+
+
+/* Seconds spent in the given layer since profiling was enabled. */
+double
+nn_layer_time(int layer)
+{
+  if (!layer_seconds || !network || layer < 0 || layer >= network->num_layers)
+    return 0.0;
+  return layer_seconds[layer];
+}
+
+
+int
+nn_have_network(void)
+{
+  return network != NULL;
+}
+
+
+int
+nn_have_value_head(void)
+{
+  return network != NULL && network->value_layer >= 0;
+}
+
+
+/* Number of input planes of a feature set, 0 if it is unknown. */
+int
+nn_feature_planes(int feature_set)
+{
+  switch (feature_set) {
+  case NN_FEATURES_KGSGO:
+    return NN_KGSGO_PLANES;
+  case NN_FEATURES_KGSGO_LADDER:
+    return NN_KGSGO_LADDER_PLANES;
+  }
+  return 0;
+}
+
+
+/* Ladder features of the last position they were read for. The
+ * orientations of one evaluation all use the same reading. Like the
+ * reading itself, the memo is kept per thread.
+ */
+static BOARD_LOCAL Hash_data ladder_hash;
+static BOARD_LOCAL int ladder_color = EMPTY;
+static BOARD_LOCAL int ladder_board_size = 0;
+static BOARD_LOCAL signed char ladder_capture[BOARDMAX];
+static BOARD_LOCAL signed char ladder_escape[BOARDMAX];
+
+
+/* Fill in the input planes of the given feature set for the current
+ * position, seen from color and transformed by rotation rot (see
+ * rotate1()). The board is placed in the upper left corner of the
+ * network's n x n input; the remaining points stay zero.
+ */
+void
+nn_encode_features(int feature_set, int color, int rot, int n, float *planes)
+{
+  int points = n * n;
+  int other = OTHER_COLOR(color);
+  int pos;
+  int rpos;
+
+  memset(planes, 0, nn_feature_planes(feature_set) * points * sizeof(float));
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+    int index;
+    int libs;
+    int plane;
+
+    if (!ON_BOARD(pos) || board[pos] == EMPTY)
+      continue;
+
+    rpos = rotate1(pos, rot);
+    index = I(rpos) * n + J(rpos);
+    libs = countlib(pos);
+    plane = (libs >= 3 ? 2 : libs - 1);
+    if (board[pos] == other)
+      plane += 3;
+    planes[plane * points + index] = 1.0;
+  }
+
+  if (board_ko_pos != NO_MOVE && is_illegal_ko_capture(board_ko_pos, color)) {
+    rpos = rotate1(board_ko_pos, rot);
+    planes[6 * points + I(rpos) * n + J(rpos)] = 1.0;
+  }
+
+  if (feature_set == NN_FEATURES_KGSGO_LADDER) {
+    if (color != ladder_color || board_size != ladder_board_size
+	|| !hashdata_is_equal(board_hash, ladder_hash)) {
+      ladder_features(color, ladder_capture, ladder_escape);
+      ladder_color = color;
+      ladder_board_size = board_size;
+      ladder_hash = board_hash;
+    }
+
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
+      if (!ladder_capture[pos] && !ladder_escape[pos])
+	continue;
+      rpos = rotate1(pos, rot);
+      if (ladder_capture[pos])
+	planes[7 * points + I(rpos) * n + J(rpos)] = 1.0;
+      if (ladder_escape[pos])
+	planes[8 * points + I(rpos) * n + J(rpos)] = 1.0;
+    }
+  }
+}
+
+
+/* Apply an activation function to count values. in and out may be
+ * the same array.
+ */
+static void
+activation_forward(int activation, int count, const float *in, float *out)
+{
+  int i;
+
+  switch (activation) {
+  case NN_ACT_RELU:
+    for (i = 0; i < count; i++)
+      out[i] = in[i] > 0.0 ? in[i] : 0.0;
+    break;
+  case NN_ACT_TANH:
+    for (i = 0; i < count; i++)
+      out[i] = tanh(in[i]);
+    break;
+  case NN_ACT_SIGMOID:
+    for (i = 0; i < count; i++)
+      out[i] = 1.0 / (1.0 + exp(-in[i]));
+    break;
+  default:
+    if (in != out)
+      memcpy(out, in, count * sizeof(float));
+    break;
+  }
+}
+
+
+/* Convolution with zero padding, so that the output has the same
+ * spatial size n x n as the input. Weights are stored as
+ * [out_planes][in_planes][kernel][kernel]. Each weight is applied to
+ * all samples of the batch before moving on to the next one. The bias
+ * initializes the output planes and the activation is applied to each
+ * plane as soon as it is complete, while it is still in the cache.
+ * Only the output planes from first up to, but not including, last
+ * are computed. Float16 weights are converted one kernel at a time,
+ * right before it is applied.
+ *
+ * The function is instantiated once for a board size given at run
+ * time and once for each of the common board sizes, where the
+ * compiler can fold the size into the loop bounds and row offsets.
+ */
+#define DEFINE_CONV_FORWARD(name, N)					\
+static void								\
+name(const struct nn_layer *layer, int size, int batch,		\
+     const float *in, float *out, int first, int last)			\
+{									\
+  const int n = ((N) > 0 ? (N) : size);				\
+  int points = n * n;							\
+  int in_stride = layer->in_planes * points;				\
+  int out_stride = layer->out_planes * points;				\
+  int k = layer->kernel;						\
+  int r = k / 2;							\
+  int o, i, ky, kx, y, x, s;						\
+  float kernel_weights[NN_MAX_KERNEL * NN_MAX_KERNEL];			\
+									\
+  for (o = first; o < last; o++) {					\
+    float b = layer->bias ? layer->bias[o] : 0.0;			\
+									\
+    for (s = 0; s < batch; s++) {					\
+      float *dst = out + s * out_stride + o * points;			\
+      for (x = 0; x < points; x++)					\
+	dst[x] = b;							\
+    }									\
+									\
+    for (i = 0; i < layer->in_planes; i++) {				\
+      int offset = (o * layer->in_planes + i) * k * k;			\
+      const float *w = layer->weights + offset;			\
+									\
+      if (layer->half_weights) {					\
+	nn_half_to_float_array(layer->half_weights + offset,		\
+			       kernel_weights, k * k);			\
+	w = kernel_weights;						\
+      }									\
+									\
+      for (ky = 0; ky < k; ky++) {					\
+	int dy = ky - r;						\
+	int y0 = gg_max(0, -dy);					\
+	int y1 = gg_min(n, n - dy);					\
+									\
+	for (kx = 0; kx < k; kx++) {					\
+	  int dx = kx - r;						\
+	  int x0 = gg_max(0, -dx);					\
+	  int x1 = gg_min(n, n - dx);					\
+	  float wv = w[ky * k + kx];					\
+									\
+	  if (wv == 0.0)						\
+	    continue;							\
+	  for (s = 0; s < batch; s++) {					\
+	    float *dst = out + s * out_stride + o * points;		\
+	    const float *src = in + s * in_stride + i * points;		\
+	    for (y = y0; y < y1; y++) {					\
+	      float *drow = dst + y * n;				\
+	      const float *srow = src + (y + dy) * n + dx;		\
+	      for (x = x0; x < x1; x++)					\
+		drow[x] += wv * srow[x];				\
+	    }								\
+	  }								\
+	}								\
+      }									\
+    }									\
+									\
+    if (layer->activation != NN_ACT_NONE)				\
+      for (s = 0; s < batch; s++) {					\
+	float *dst = out + s * out_stride + o * points;			\
+	activation_forward(layer->activation, points, dst, dst);	\
+      }									\
+  }									\
+}
+
+DEFINE_CONV_FORWARD(conv_forward_any, 0)
+DEFINE_CONV_FORWARD(conv_forward_9, 9)
+DEFINE_CONV_FORWARD(conv_forward_13, 13)
+DEFINE_CONV_FORWARD(conv_forward_19, 19)
+
+
+static void
+conv_planes(const struct nn_layer *layer, int n, int batch,
+	    const float *in, float *out, int first, int last)
+{
+  switch (n) {
+  case 9:
+    conv_forward_9(layer, n, batch, in, out, first, last);
+    break;
+  case 13:
+    conv_forward_13(layer, n, batch, in, out, first, last);
+    break;
+  case 19:
+    conv_forward_19(layer, n, batch, in, out, first, last);
+    break;
+  default:
+    conv_forward_any(layer, n, batch, in, out, first, last);
+    break;
+  }
+}
+
+
+/* Smallest number of multiply-adds worth handing to another thread. */
+#define NN_MIN_TASK_WORK 200000
+
+/* A convolution split by output planes over the thread pool. */
+struct conv_job {
+  const struct nn_layer *layer;
+  int n;
+  int batch;
+  const float *in;
+  float *out;
+  int tasks;
+};
+
+
+static void
+conv_task(void *arg, int index)
+{
+  const struct conv_job *job = arg;
+  int planes = job->layer->out_planes;
+
+  conv_planes(job->layer, job->n, job->batch, job->in, job->out,
+	      planes * index / job->tasks,
+	      planes * (index + 1) / job->tasks);
+}
+
+
+/* Run a convolution, split over the thread pool (nnpool.c) when it is
+ * large enough for that to pay off. Every task computes its own
+ * output planes, so they need no synchronization until the layer is
+ * complete.
+ */
+static void
+conv_forward(const struct nn_layer *layer, int n, int batch,
+	     const float *in, float *out)
+{
+  struct conv_job job;
+  double work = ((double) layer->out_planes * layer->in_planes
+		 * layer->kernel * layer->kernel * n * n * batch);
+  int tasks = gg_min(nn_pool_threads(), layer->out_planes);
+
+  tasks = gg_min(tasks, (int) (work / NN_MIN_TASK_WORK));
+  if (tasks <= 1) {
+    conv_planes(layer, n, batch, in, out, 0, layer->out_planes);
+    return;
+  }
+
+  job.layer = layer;
+  job.n = n;
+  job.batch = batch;
+  job.in = in;
+  job.out = out;
+  job.tasks = tasks;
+  nn_pool_run(tasks, conv_task, &job);
+}
+
+
+/* Fully connected layer. Weights are stored as [outputs][inputs]. */
+static void
+fc_forward(const struct nn_layer *layer, int batch, const float *in,
+	   float *out)
+{
+  int inputs = layer->in_planes * layer->in_size;
+  int o, i, s;
+
+  for (o = 0; o < layer->out_planes; o++) {
+    const float *w = layer->weights + o * inputs;
+    for (s = 0; s < batch; s++) {
+      const float *x = in + s * inputs;
+      float sum = layer->bias ? layer->bias[o] : 0.0;
+      for (i = 0; i < inputs; i++)
+	sum += w[i] * x[i];
+      out[s * layer->out_planes + o] = sum;
+    }
+  }
+
+  if (layer->activation != NN_ACT_NONE)
+    activation_forward(layer->activation, batch * layer->out_planes,
+		       out, out);
+}
+
+
+/* Batch normalisation which could not be folded into the previous
+ * layer, reduced at load time to a per plane scale (weights) and
+ * shift (bias). Planes have size points.
+ */
+static void
+bn_forward(const struct nn_layer *layer, int size, int batch,
+	   const float *in, float *out)
+{
+  int c, s, x;
+
+  for (s = 0; s < batch; s++)
+    for (c = 0; c < layer->out_planes; c++) {
+      const float *src = in + (s * layer->out_planes + c) * size;
+      float *dst = out + (s * layer->out_planes + c) * size;
+      float scale = layer->weights[c];
+      float shift = layer->bias[c];
+      for (x = 0; x < size; x++)
+	dst[x] = src[x] * scale + shift;
+      if (layer->activation != NN_ACT_NONE)
+	activation_forward(layer->activation, size, dst, dst);
+    }
+}
+
+
+static void
+softmax_forward(int count, const float *in, float *out)
+{
+  float max = in[0];
+  double sum = 0.0;
+  int i;
+
+  for (i = 1; i < count; i++)
+    if (in[i] > max)
+      max = in[i];
+  for (i = 0; i < count; i++) {
+    out[i] = exp(in[i] - max);
+    sum += out[i];
+  }
+  for (i = 0; i < count; i++)
+    out[i] /= sum;
+}
+
+
+/* The width of the input planes to run model at for a board of the
+ * given size: the board size itself for fully convolutional networks,
+ * otherwise the size the network was made for.
+ */
+int
+nn_eval_size(const struct nn_model *model, int size)
+{
+  if (model->fully_convolutional && size <= model->header->board_size)
+    return size;
+  return model->header->board_size;
+}
+
+
+/* Points per plane of layer when the network is run at width n. */
+static int
+layer_points(const struct nn_model *model, const struct nn_layer *layer,
+	     int n)
+{
+  if (model->fully_convolutional)
+    return n * n;
+  return layer->out_size;
+}
+
+
+/* Number of floats of input planes the network takes per sample when
+ * run at width n.
+ */
+int
+nn_input_size(const struct nn_model *model, int n)
+{
+  return model->header->input_planes * n * n;
+}
+
+
+/* Number of floats the network produces per sample when run at
+ * width n.
+ */
+int
+nn_output_size(const struct nn_model *model, int n)
+{
+  const struct nn_layer *last = &model->layers[model->num_layers - 1];
+  return last->out_planes * layer_points(model, last, n);
+}
+
+
+/* Allocate an arena for running model on batches of up to max_batch
+ * samples. Returns NULL if we run out of memory.
+ */
+struct nn_arena *
+nn_arena_new(const struct nn_model *model, int max_batch)
+{
+  struct nn_arena *arena = malloc(sizeof(*arena));
+  size_t floats;
+
+  if (!arena)
+    return NULL;
+
+  arena->max_batch = max_batch;
+  arena->num_buffers = model->num_buffers;
+  arena->buffer_floats = model->buffer_floats;
+  arena->input_floats = nn_input_size(model, model->header->board_size);
+  arena->output_floats = nn_output_size(model, model->header->board_size);
+
+  floats = (size_t) max_batch * (arena->num_buffers * arena->buffer_floats
+				 + arena->input_floats
+				 + arena->output_floats + 1);
+  arena->buffers = malloc(floats * sizeof(float));
+  if (!arena->buffers) {
+    free(arena);
+    return NULL;
+  }
+  arena->input = (arena->buffers
+		  + max_batch * arena->num_buffers * arena->buffer_floats);
+  arena->output = arena->input + max_batch * arena->input_floats;
+  arena->value = arena->output + max_batch * arena->output_floats;
+
+  return arena;
+}
+
+
+void
+nn_arena_free(struct nn_arena *arena)
+{
+  if (!arena)
+    return;
+  free(arena->buffers);
+  free(arena);
+}
+
+
+/* Return 1 if arena is large enough to run model on batch samples. */
+int
+nn_arena_fits(const struct nn_arena *arena, const struct nn_model *model,
+	      int batch)
+{
+  return (arena != NULL
+	  && batch <= arena->max_batch
+	  && model->num_buffers <= arena->num_buffers
+	  && model->buffer_floats <= arena->buffer_floats
+	  && (nn_input_size(model, model->header->board_size)
+	      <= arena->input_floats)
+	  && (nn_output_size(model, model->header->board_size)
+	      <= arena->output_floats));
+}
+
+
+/* Run the network at width n, as returned by nn_eval_size(), on a
+ * batch of input planes, as produced by nn_encode_features(), and
+ * write the output of the last layer for each sample to output. The
+ * samples are packed, nn_input_size() and nn_output_size() floats
+ * apart. If value is not NULL it receives the value
+ * head output for each sample, or 0.0 if the network has none.
+ * Intermediate results go to the activation buffers in arena,
+ * following the buffer plan made when the network was loaded, so
+ * nothing is allocated here.
+ */
+void
+nn_forward_batch(const struct nn_model *model, struct nn_arena *arena,
+		 int n, int batch, const float *input, float *output,
+		 float *value)
+{
+  int stride = arena->max_batch * arena->buffer_floats;
+  int k, s;
+
+  gg_assert(nn_arena_fits(arena, model, batch));
+  gg_assert(n == nn_eval_size(model, n));
+
+  for (k = 0; k < model->num_layers; k++) {
+    const struct nn_layer *layer = &model->layers[k];
+    const float *in;
+    float *out;
+    int points = layer_points(model, layer, n);
+    int count = layer->out_planes * points;
+    double start = 0.0;
+
+    if (layer->input < 0)
+      in = input;
+    else
+      in = arena->buffers + model->layers[layer->input].buffer * stride;
+    if (layer->buffer < 0)
+      out = output;
+    else
+      out = arena->buffers + layer->buffer * stride;
+
+    if (layer_seconds && model == network)
+      start = gg_gettimeofday();
+
+    switch (layer->type) {
+    case NN_LAYER_CONV:
+      conv_forward(layer, n, batch, in, out);
+      break;
+    case NN_LAYER_FC:
+      fc_forward(layer, batch, in, out);
+      break;
+    case NN_LAYER_BN:
+      bn_forward(layer, points, batch, in, out);
+      break;
+    case NN_LAYER_ACTIVATION:
+      activation_forward(layer->activation, batch * count, in, out);
+      break;
+    case NN_LAYER_SOFTMAX:
+      for (s = 0; s < batch; s++)
+	softmax_forward(count, in + s * count, out + s * count);
+      break;
+    }
+
+    if (layer_seconds && model == network)
+      layer_seconds[k] += gg_gettimeofday() - start;
+  }
+
+  if (value) {
+    for (s = 0; s < batch; s++)
+      if (model->value_layer >= 0)
+	value[s] = arena->buffers[model->layers[model->value_layer].buffer
+				  * stride + s];
+      else
+	value[s] = 0.0;
+  }
+}
+
+
+/* Convert the network output for the current position, evaluated at
+ * width n in orientation rot, into move probabilities over the points
+ * of the board.
+ */
+static void
+output_to_policy(const struct nn_model *model, int n, const float *result,
+		 int rot, float policy[BOARDMAX])
+{
+  int logits = (model->layers[model->num_layers - 1].type
+		!= NN_LAYER_SOFTMAX);
+  float max = 0.0;
+  double sum = 0.0;
+  int pos;
+  int rpos;
+
+  /* Networks without a final softmax layer produce logits. */
+  if (logits) {
+    max = result[0];
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+      if (ON_BOARD(pos) && result[I(pos) * n + J(pos)] > max)
+	max = result[I(pos) * n + J(pos)];
+  }
+
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+    if (ON_BOARD(pos)) {
+      float v;
+      rpos = rotate1(pos, rot);
+      v = result[I(rpos) * n + J(rpos)];
+      policy[pos] = (logits ? exp(v - max) : v);
+      sum += policy[pos];
+    }
+
+  if (sum > 0.0)
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+      policy[pos] /= sum;
+}
+
+
+/* Number of samples nn_batch_add() encodes per position. */
+static int
+samples_per_position(void)
+{
+  return (nn_symmetry == NN_SYMMETRY_FULL ? 8 : 1);
+}
+
+
+/* Return the number of positions which may be queued with
+ * nn_batch_add() before nn_batch_evaluate() is called: nn_batch_size,
+ * but no more than fit into NN_MAX_BATCH samples, and at least 1. The
+ * arena is enlarged here if needed, so this should be called before
+ * a batch is started.
+ */
+int
+nn_batch_capacity(void)
+{
+  int samples = samples_per_position();
+  int positions = gg_max(1, gg_min(nn_batch_size, NN_MAX_BATCH / samples));
+
+  if (!network)
+    return 1;
+
+  if (batch_positions == 0 || batch_evaluated) {
+    if (!nn_arena_fits(eval_arena, network, positions * samples)) {
+      struct nn_arena *arena = nn_arena_new(network, positions * samples);
+      if (arena) {
+	nn_arena_free(eval_arena);
+	eval_arena = arena;
+      }
+    }
+  }
+
+  return gg_max(1, gg_min(positions, eval_arena->max_batch / samples));
+}
+
+
+/* Queue the current position, with color to move, for evaluation by
+ * the network and return its index in the batch, to be passed to
+ * nn_batch_result() after nn_batch_evaluate(). Returns -1 if no
+ * network is loaded or the board is larger than the network.
+ *
+ * Positions found in the network cache are not evaluated again. The
+ * others are encoded into the input planes right away, so the board
+ * may change before the batch is evaluated. No more positions than
+ * returned by nn_batch_capacity() may be queued.
+ */
+int
+nn_batch_add(int color)
+{
+  struct batch_entry *entry;
+  int input_size;
+  int k;
+
+  if (!network || board_size > network->header->board_size)
+    return -1;
+
+  if (batch_evaluated) {
+    batch_positions = 0;
+    batch_samples = 0;
+    batch_evaluated = 0;
+  }
+  if (batch_positions == 0)
+    batch_n = nn_eval_size(network, board_size);
+  gg_assert(batch_n == nn_eval_size(network, board_size));
+
+  gg_assert(batch_positions < NN_MAX_BATCH);
+  entry = &batch[batch_positions];
+  memset(entry->policy, 0, sizeof(entry->policy));
+  entry->value = 0.0;
+  nn_cache_make_key(color, &entry->key);
+  entry->cached = nn_cache_lookup(&entry->key, entry->policy, &entry->value);
+  entry->first = batch_samples;
+  entry->samples = 0;
+
+  if (!entry->cached) {
+    if (nn_symmetry == NN_SYMMETRY_FULL) {
+      entry->samples = 8;
+      for (k = 0; k < 8; k++)
+	entry->rot[k] = k;
+    }
+    else {
+      entry->samples = 1;
+      entry->rot[0] = (nn_symmetry == NN_SYMMETRY_RANDOM ? gg_urand() % 8 : 0);
+    }
+
+    gg_assert(batch_samples + entry->samples <= eval_arena->max_batch);
+    input_size = nn_input_size(network, batch_n);
+    for (k = 0; k < entry->samples; k++)
+      nn_encode_features(network->header->feature_set, color, entry->rot[k],
+			 batch_n,
+			 eval_arena->input + (entry->first + k) * input_size);
+    batch_samples += entry->samples;
+  }
+
+  return batch_positions++;
+}
+
+
+/* Run the positions queued with nn_batch_add() through the network,
+ * as a single batch, and store the results in the network cache.
+ */
+void
+nn_batch_evaluate(void)
+{
+  int output_size;
+  int evaluated = 0;
+  int k;
+  int s;
+
+  if (batch_evaluated || batch_positions == 0)
+    return;
+  batch_evaluated = 1;
+  if (batch_samples == 0)
+    return;
+
+  nn_forward_batch(network, eval_arena, batch_n, batch_samples,
+		   eval_arena->input, eval_arena->output, eval_arena->value);
+
+  output_size = nn_output_size(network, batch_n);
+  for (k = 0; k < batch_positions; k++) {
+    struct batch_entry *entry = &batch[k];
+    const float *result = eval_arena->output + entry->first * output_size;
+    float sum;
+
+    if (entry->cached)
+      continue;
+    evaluated++;
+
+    if (entry->samples == 1)
+      output_to_policy(network, batch_n, result, entry->rot[0],
+		       entry->policy);
+    else {
+      float sample_policy[BOARDMAX];
+      int pos;
+
+      for (s = 0; s < entry->samples; s++) {
+	output_to_policy(network, batch_n, result + s * output_size,
+			 entry->rot[s], sample_policy);
+	for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+	  entry->policy[pos] += sample_policy[pos] / entry->samples;
+      }
+    }
+
+    sum = 0.0;
+    for (s = 0; s < entry->samples; s++)
+      sum += eval_arena->value[entry->first + s];
+    entry->value = sum / entry->samples;
+    nn_cache_store(&entry->key, entry->policy, entry->value);
+  }
+
+  batch_stats.batches++;
+  batch_stats.evaluations += evaluated;
+  batch_stats.batch_size[evaluated]++;
+}
+
+
+/* Retrieve the result for a position queued with nn_batch_add(), in
+ * the same form as from nn_evaluate().
+ */
+void
+nn_batch_result(int index, float policy[BOARDMAX], float *value)
+{
+  gg_assert(batch_evaluated && index >= 0 && index < batch_positions);
+  memcpy(policy, batch[index].policy, sizeof(batch[index].policy));
+  if (value)
+    *value = batch[index].value;
+}
+
+
+void
+nn_batch_get_stats(struct nn_batch_stats *stats)
+{
+  *stats = batch_stats;
+}
+
+
+/* Evaluate the current position with the network, for color to move.
+ * On return policy[pos] holds the probability that the move at pos
+ * is played, normalized over the points of the board; off-board
+ * entries are zero. If value is not NULL it receives the value head's
+ * estimate of the outcome for color, between -1 and 1, or 0.0 for
+ * networks without a value head. Returns 0 if no network is loaded
+ * or the board is larger than the network.
+ *
+ * Depending on nn_symmetry the network sees the position as it is, in
+ * a randomly chosen one of the 8 orientations, or in all 8
+ * orientations at once, as a single batch, and the results are
+ * averaged.
+ *
+ * Results are remembered in the network cache (nncache.c). This is a
+ * batch of one position; callers which can collect several positions
+ * use nn_batch_add() and nn_batch_evaluate() directly.
+ */
+int
+nn_evaluate(int color, float policy[BOARDMAX], float *value)
+{
+  int index = nn_batch_add(color);
+
+  if (index < 0) {
+    memset(policy, 0, BOARDMAX * sizeof(float));
+    if (value)
+      *value = 0.0;
+    return 0;
+  }
+
+  nn_batch_evaluate();
+  nn_batch_result(index, policy, value);
+  return 1;
+}
+
+
+/* Set how positions are oriented for the network, one of the
+ * NN_SYMMETRY_* values. Cached evaluations were made with the old
+ * setting and are dropped.
+ */
+void
+nn_set_symmetry(int mode)
+{
+  if (mode != nn_symmetry) {
+    nn_symmetry = mode;
+    nn_cache_clear();
+  }
+}
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
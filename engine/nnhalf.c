@@ -0,0 +1,192 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Conversion between single precision floats and IEEE 754 half
+ * precision values, which network files may use to store convolution
+ * weights in half the space. Converting to float is exact.
+ *
+ * The weights of the convolutions are converted with the F16C
+ * instructions if the CPU has them. This is detected at run time, so
+ * a default build uses them whenever the compiler supports the target
+ * attribute (HAVE_F16C_TARGET). Compiled with F16C enabled (gcc
+ * -mf16c, or -march on a CPU which has it) the single value
+ * conversions use the instructions too. Otherwise the conversions are
+ * done bit by bit.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "nnmodel.h"
+
+#if defined(__F16C__) || HAVE_F16C_TARGET
+#include <immintrin.h>
+#endif
+
+
+/* Round a float to the nearest half precision value, ties to even.
+ * Values too large for half precision become infinite.
+ */
+unsigned short
+nn_float_to_half(float f)
+{
+#ifdef __F16C__
+  return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+  unsigned int x;
+  unsigned int sign;
+  unsigned int mantissa;
+  int exponent;
+
+  memcpy(&x, &f, sizeof(x));
+  sign = (x >> 16) & 0x8000;
+  exponent = (int) ((x >> 23) & 0xff) - 127 + 15;
+  mantissa = x & 0x7fffff;
+
+  /* Infinity and NaN, keeping NaNs quiet and nonzero. */
+  if (((x >> 23) & 0xff) == 0xff)
+    return sign | 0x7c00 | (mantissa ? 0x200 | (mantissa >> 13) : 0);
+
+  if (exponent >= 31)
+    return sign | 0x7c00;
+
+  if (exponent <= 0) {
+    /* Subnormal half or zero. */
+    int shift;
+    unsigned int half;
+    unsigned int rest;
+
+    if (exponent < -10)
+      return sign;
+    mantissa |= 0x800000;
+    shift = 14 - exponent;
+    half = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    if (rest > (1u << (shift - 1))
+	|| (rest == (1u << (shift - 1)) && (half & 1)))
+      half++;
+    return sign | half;
+  }
+
+  /* Normal half. A carry out of the mantissa correctly increments the
+   * exponent, up to infinity.
+   */
+  {
+    unsigned int half = ((unsigned int) exponent << 10) | (mantissa >> 13);
+    unsigned int rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+      half++;
+    return sign | half;
+  }
+#endif
+}
+
+
+float
+nn_half_to_float(unsigned short h)
+{
+#ifdef __F16C__
+  return _cvtsh_ss(h);
+#else
+  unsigned int sign = (unsigned int) (h & 0x8000) << 16;
+  unsigned int exponent = (h >> 10) & 0x1f;
+  unsigned int mantissa = h & 0x3ff;
+  unsigned int x;
+  float f;
+
+  if (exponent == 0x1f)
+    x = sign | 0x7f800000 | (mantissa << 13);
+  else if (exponent != 0)
+    x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  else if (mantissa == 0)
+    x = sign;
+  else {
+    /* Subnormal half, normal float. */
+    exponent = 127 - 15 + 1;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+
+  memcpy(&f, &x, sizeof(f));
+  return f;
+#endif
+}
+
+
+#if HAVE_F16C_TARGET && !defined(__F16C__)
+
+/* nn_half_to_float_array() for CPUs with F16C. */
+__attribute__((target("avx,f16c")))
+static void
+half_to_float_f16c(const unsigned short *in, float *out, int count)
+{
+  int k = 0;
+
+  for (; k + 8 <= count; k += 8)
+    _mm256_storeu_ps(out + k,
+		     _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)
+						     (in + k))));
+  for (; k < count; k++)
+    out[k] = _cvtsh_ss(in[k]);
+}
+
+#endif
+
+
+/* Convert count half precision values to floats. This is used by the
+ * convolution for each kernel just before it is applied.
+ */
+void
+nn_half_to_float_array(const unsigned short *in, float *out, int count)
+{
+  int k = 0;
+
+#ifdef __F16C__
+  for (; k + 8 <= count; k += 8)
+    _mm256_storeu_ps(out + k,
+		     _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)
+						     (in + k))));
+#elif HAVE_F16C_TARGET
+  if (__builtin_cpu_supports("f16c")) {
+    half_to_float_f16c(in, out, count);
+    return;
+  }
+#endif
+
+  for (; k < count; k++)
+    out[k] = nn_half_to_float(in[k]);
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,762 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if HAVE_SYS_MMAN_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "nnmodel.h"
+
+
+/* Map the file read-only. The mapping is shared, so every process
+ * using the same network shares the physical pages. When mmap() is
+ * not available the file is read into an allocated buffer instead,
+ * which is correct but loses the sharing.
+ */
+static int
+map_file(const char *filename, struct nn_model *model)
+{
+#if HAVE_SYS_MMAN_H
+  int fd;
+  struct stat st;
+  void *p;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror(filename);
+    return 0;
+  }
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+    fprintf(stderr, "%s: cannot determine file size\n", filename);
+    close(fd);
+    return 0;
+  }
+
+  p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror(filename);
+    return 0;
+  }
+
+  model->base = p;
+  model->size = (size_t) st.st_size;
+  model->mapped = 1;
+  return 1;
+#else
+  FILE *f;
+  long size;
+  char *p;
+
+  f = fopen(filename, "rb");
+  if (!f) {
+    perror(filename);
+    return 0;
+  }
+  if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0) {
+    fprintf(stderr, "%s: cannot determine file size\n", filename);
+    fclose(f);
+    return 0;
+  }
+  rewind(f);
+
+  /* malloc() alignment is enough for the header and the layer table,
+   * but the tensors are only guaranteed to be aligned relative to the
+   * start of the file.
+   */
+  p = malloc(size);
+  if (!p || fread(p, 1, size, f) != (size_t) size) {
+    fprintf(stderr, "%s: cannot read file\n", filename);
+    free(p);
+    fclose(f);
+    return 0;
+  }
+  fclose(f);
+
+  model->base = p;
+  model->size = (size_t) size;
+  model->mapped = 0;
+  return 1;
+#endif
+}
+
+
+static void
+unmap_file(struct nn_model *model)
+{
+  if (!model->base)
+    return;
+#if HAVE_SYS_MMAN_H
+  if (model->mapped) {
+    munmap((void *) model->base, model->size);
+    model->base = NULL;
+    return;
+  }
+#endif
+  free((void *) model->base);
+  model->base = NULL;
+}
+
+
+/* Check that a tensor of count floats at offset lies inside the file
+ * and is properly aligned.
+ */
+static int
+check_tensor(const struct nn_model *model, unsigned int offset,
+	     unsigned int count, size_t element_size)
+{
+  if (offset == 0)
+    return count == 0;
+  if (offset % NN_MODEL_ALIGN != 0)
+    return 0;
+  if (offset > model->size
+      || (model->size - offset) / element_size < count)
+    return 0;
+  return 1;
+}
+
+
+/* Number of floats a layer must have as weights and bias. The bias
+ * may also be left out.
+ */
+static void
+expected_counts(const struct nn_layer_desc *desc, int in_size,
+		unsigned int *weights, unsigned int *bias)
+{
+  switch (desc->type) {
+  case NN_LAYER_CONV:
+    *weights = desc->out_planes * desc->in_planes
+      * desc->kernel * desc->kernel;
+    *bias = desc->out_planes;
+    break;
+  case NN_LAYER_FC:
+    *weights = desc->out_planes * desc->in_planes * in_size;
+    *bias = desc->out_planes;
+    break;
+  case NN_LAYER_BN:
+    *weights = 4 * desc->out_planes;
+    *bias = 0;
+    break;
+  default:
+    *weights = 0;
+    *bias = 0;
+    break;
+  }
+}
+
+
+/* Assign the layer outputs to activation buffers. A buffer can be
+ * reused as soon as the last layer reading the output it holds has
+ * run, so a plain chain of layers ping-pongs between two buffers. The
+ * last layer writes straight into the caller's output.
+ */
+static int
+plan_buffers(struct nn_model *model)
+{
+  int num_layers = model->num_layers;
+  int *last_use;
+  int *owner;
+  int k, b;
+
+  last_use = malloc(2 * num_layers * sizeof(int));
+  if (!last_use) {
+    perror("Couldn't allocate memory for buffer plan");
+    return 0;
+  }
+  owner = last_use + num_layers;
+
+  for (k = 0; k < num_layers; k++) {
+    last_use[k] = k;
+    if (model->layers[k].input >= 0)
+      last_use[model->layers[k].input] = k;
+  }
+
+  /* The value is read after the last layer has run. */
+  if (model->value_layer >= 0)
+    last_use[model->value_layer] = num_layers;
+
+  model->num_buffers = 0;
+  model->buffer_floats = 0;
+  for (k = 0; k < num_layers - 1; k++) {
+    struct nn_layer *layer = &model->layers[k];
+
+    /* The input of layer k is still live, so it is never chosen. */
+    for (b = 0; b < model->num_buffers; b++)
+      if (last_use[owner[b]] < k)
+	break;
+    if (b == model->num_buffers)
+      model->num_buffers++;
+    owner[b] = k;
+    layer->buffer = b;
+    model->buffer_floats = gg_max(model->buffer_floats,
+				  layer->out_planes * layer->out_size);
+  }
+  model->layers[num_layers - 1].buffer = -1;
+
+  free(last_use);
+  return 1;
+}
+
+
+/* Validate the header and the layer table and set up the layer
+ * pointers. Only the metadata is touched, never the tensors.
+ */
+static int
+setup_layers(const char *filename, struct nn_model *model)
+{
+  const struct nn_file_header *h;
+  const struct nn_layer_desc *descs;
+  int points;
+  int k;
+
+  if (model->size < sizeof(struct nn_file_header)) {
+    fprintf(stderr, "%s: file too short\n", filename);
+    return 0;
+  }
+
+  h = (const struct nn_file_header *) model->base;
+  if (memcmp(h->magic, NN_MODEL_MAGIC, 4) != 0) {
+    fprintf(stderr, "%s: not a network file\n", filename);
+    return 0;
+  }
+  if (h->byte_order != NN_MODEL_BYTE_ORDER) {
+    fprintf(stderr, "%s: network file has wrong byte order\n", filename);
+    return 0;
+  }
+  if (h->version < 1 || h->version > NN_MODEL_VERSION
+      || h->header_size != (int) sizeof(struct nn_file_header)
+      || h->layer_desc_size != (int) sizeof(struct nn_layer_desc)) {
+    fprintf(stderr, "%s: unsupported network file version %d\n",
+	    filename, h->version);
+    return 0;
+  }
+  if (h->file_size != model->size) {
+    fprintf(stderr, "%s: network file is truncated\n", filename);
+    return 0;
+  }
+  if (h->num_layers <= 0
+      || h->board_size < MIN_BOARD || h->board_size > MAX_BOARD
+      || h->input_planes <= 0
+      || (size_t) h->header_size + h->num_layers * sizeof(*descs)
+         > model->size) {
+    fprintf(stderr, "%s: corrupt network header\n", filename);
+    return 0;
+  }
+  if (nn_feature_planes(h->feature_set) == 0
+      || h->input_planes != nn_feature_planes(h->feature_set)) {
+    fprintf(stderr, "%s: unknown input feature set %d\n",
+	    filename, h->feature_set);
+    return 0;
+  }
+
+  model->header = h;
+  model->num_layers = h->num_layers;
+  model->layers = calloc(h->num_layers, sizeof(struct nn_layer));
+  if (!model->layers) {
+    perror("Couldn't allocate memory for network layers");
+    return 0;
+  }
+
+  descs = (const struct nn_layer_desc *) (model->base + h->header_size);
+  points = h->board_size * h->board_size;
+  for (k = 0; k < h->num_layers; k++) {
+    const struct nn_layer_desc *d = &descs[k];
+    struct nn_layer *layer = &model->layers[k];
+    int in_planes;
+    unsigned int weights;
+    unsigned int bias;
+    int format = (h->version >= 2 ? d->weights_format : NN_WEIGHTS_FLOAT32);
+
+    if (d->input < -1 || d->input >= k) {
+      fprintf(stderr, "%s: layer %d reads from invalid layer %d\n",
+	      filename, k, d->input);
+      return 0;
+    }
+    if (d->input == -1) {
+      in_planes = h->input_planes;
+      layer->in_size = points;
+    }
+    else {
+      in_planes = model->layers[d->input].out_planes;
+      layer->in_size = model->layers[d->input].out_size;
+    }
+
+    if (d->in_planes != in_planes || d->out_planes <= 0) {
+      fprintf(stderr, "%s: layer %d has inconsistent shape\n", filename, k);
+      return 0;
+    }
+
+    switch (d->type) {
+    case NN_LAYER_CONV:
+      if (d->kernel <= 0 || d->kernel % 2 == 0 || d->kernel > NN_MAX_KERNEL
+	  || layer->in_size != points) {
+	fprintf(stderr, "%s: layer %d is not a valid convolution\n",
+		filename, k);
+	return 0;
+      }
+      layer->out_size = points;
+      break;
+    case NN_LAYER_FC:
+      layer->out_size = 1;
+      break;
+    case NN_LAYER_ACTIVATION:
+    case NN_LAYER_SOFTMAX:
+      if (d->out_planes != d->in_planes
+	  || d->activation < NN_ACT_NONE || d->activation > NN_ACT_SIGMOID) {
+	fprintf(stderr, "%s: layer %d has inconsistent shape\n",
+		filename, k);
+	return 0;
+      }
+      layer->out_size = layer->in_size;
+      break;
+    case NN_LAYER_BN:
+      if (d->out_planes != d->in_planes) {
+	fprintf(stderr, "%s: layer %d has inconsistent shape\n",
+		filename, k);
+	return 0;
+      }
+      layer->out_size = layer->in_size;
+      break;
+    default:
+      fprintf(stderr, "%s: layer %d has unknown type %d\n",
+	      filename, k, d->type);
+      return 0;
+    }
+
+    if (format != NN_WEIGHTS_FLOAT32
+	&& (format != NN_WEIGHTS_FLOAT16 || d->type != NN_LAYER_CONV)) {
+      fprintf(stderr, "%s: layer %d has unsupported weights format %d\n",
+	      filename, k, format);
+      return 0;
+    }
+
+    expected_counts(d, layer->in_size, &weights, &bias);
+    if (d->weights_count != weights
+	|| (d->bias_count != bias && d->bias_count != 0)
+	|| !check_tensor(model, d->weights_offset, d->weights_count,
+			 (format == NN_WEIGHTS_FLOAT16
+			  ? sizeof(unsigned short) : sizeof(float)))
+	|| !check_tensor(model, d->bias_offset, d->bias_count,
+			 sizeof(float))) {
+      fprintf(stderr, "%s: layer %d has invalid weights\n", filename, k);
+      return 0;
+    }
+
+    layer->desc = d;
+    layer->type = d->type;
+    layer->activation = (d->type == NN_LAYER_ACTIVATION
+			 ? d->activation : NN_ACT_NONE);
+    layer->input = d->input;
+    layer->in_planes = d->in_planes;
+    layer->out_planes = d->out_planes;
+    layer->kernel = d->kernel;
+    layer->first = k;
+    layer->last = k;
+    if (d->weights_offset && format == NN_WEIGHTS_FLOAT16)
+      layer->half_weights = (const unsigned short *) (model->base
+						      + d->weights_offset);
+    else if (d->weights_offset)
+      layer->weights = (const float *) (model->base + d->weights_offset);
+    if (d->bias_offset)
+      layer->bias = (const float *) (model->base + d->bias_offset);
+  }
+
+  /* The policy output must cover the board. */
+  if (model->layers[h->num_layers - 1].out_planes
+      * model->layers[h->num_layers - 1].out_size != points) {
+    fprintf(stderr, "%s: last layer does not produce %d outputs\n",
+	    filename, points);
+    return 0;
+  }
+
+  /* The value head, if any, must be a branch producing one output. */
+  if (h->value_layer != 0
+      && (h->value_layer < 0 || h->value_layer >= h->num_layers - 1
+	  || (model->layers[h->value_layer].out_planes
+	      * model->layers[h->value_layer].out_size) != 1)) {
+    fprintf(stderr, "%s: invalid value layer %d\n", filename, h->value_layer);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/* Compute the per plane scale and shift a batch normalisation layer
+ * amounts to. Returns 0 if a variance is negative.
+ */
+static int
+bn_scale_shift(const struct nn_layer *bn, float *scale, float *shift)
+{
+  int planes = bn->out_planes;
+  const float *gamma = bn->weights;
+  const float *beta = bn->weights + planes;
+  const float *mean = bn->weights + 2 * planes;
+  const float *variance = bn->weights + 3 * planes;
+  int c;
+
+  for (c = 0; c < planes; c++) {
+    if (!(variance[c] >= 0.0))
+      return 0;
+    scale[c] = gamma[c] / sqrt(variance[c] + NN_BN_EPSILON);
+    shift[c] = beta[c] - mean[c] * scale[c];
+  }
+  return 1;
+}
+
+
+/* Fold the batch normalisation bn into the convolution or fully
+ * connected layer, which gets its own rescaled copy of the weights.
+ * Float16 weights are rescaled in single precision and stored as
+ * float16 again.
+ */
+static int
+fold_bn(const char *filename, struct nn_layer *layer,
+	const struct nn_layer *bn)
+{
+  int planes = layer->out_planes;
+  int per_output = layer->desc->weights_count / planes;
+  size_t weight_size = (layer->half_weights
+			? sizeof(unsigned short) : sizeof(float));
+  float *scale;
+  float *shift;
+  float *bias;
+  float *weights = NULL;
+  unsigned short *half_weights = NULL;
+  int o, i;
+
+  layer->owned = malloc(3 * planes * sizeof(float)
+			+ planes * per_output * weight_size);
+  if (!layer->owned) {
+    perror("Couldn't allocate memory for folded weights");
+    return 0;
+  }
+  bias = layer->owned;
+  scale = bias + planes;
+  shift = scale + planes;
+  if (layer->half_weights)
+    half_weights = (unsigned short *) (shift + planes);
+  else
+    weights = shift + planes;
+
+  if (!bn_scale_shift(bn, scale, shift)) {
+    fprintf(stderr, "%s: layer %d has a negative variance\n",
+	    filename, bn->first);
+    return 0;
+  }
+
+  for (o = 0; o < planes; o++) {
+    for (i = 0; i < per_output; i++) {
+      int w = o * per_output + i;
+      if (half_weights) {
+	float v = nn_half_to_float(layer->half_weights[w]);
+	half_weights[w] = nn_float_to_half(v * scale[o]);
+      }
+      else
+	weights[w] = layer->weights[w] * scale[o];
+    }
+    bias[o] = (layer->bias ? layer->bias[o] : 0.0) * scale[o] + shift[o];
+  }
+
+  if (half_weights)
+    layer->half_weights = half_weights;
+  else
+    layer->weights = weights;
+  layer->bias = bias;
+  layer->folded_bn = 1;
+  return 1;
+}
+
+
+/* A batch normalisation which cannot be folded is run as a per plane
+ * scale (weights) and shift (bias).
+ */
+static int
+bn_to_affine(const char *filename, struct nn_layer *layer)
+{
+  float *owned = malloc(2 * layer->out_planes * sizeof(float));
+
+  if (!owned) {
+    perror("Couldn't allocate memory for batch normalisation");
+    return 0;
+  }
+  if (!bn_scale_shift(layer, owned, owned + layer->out_planes)) {
+    fprintf(stderr, "%s: layer %d has a negative variance\n",
+	    filename, layer->first);
+    free(owned);
+    return 0;
+  }
+
+  layer->owned = owned;
+  layer->weights = owned;
+  layer->bias = owned + layer->out_planes;
+  return 1;
+}
+
+
+/* Merge file layers into the layers which are executed: batch
+ * normalisation directly following a convolution or fully connected
+ * layer is folded into its weights and bias, and an activation
+ * directly following a convolution, fully connected or batch
+ * normalisation layer is applied in its epilogue. Layers are only
+ * merged when the intermediate output has no other reader.
+ */
+static int
+optimise_layers(const char *filename, struct nn_model *model)
+{
+  int num_layers = model->num_layers;
+  struct nn_layer *layers = model->layers;
+  int *readers;
+  int *executed;
+  int k, m;
+
+  readers = calloc(2 * num_layers, sizeof(int));
+  if (!readers) {
+    perror("Couldn't allocate memory for network layers");
+    return 0;
+  }
+  executed = readers + num_layers;
+
+  for (k = 0; k < num_layers; k++)
+    if (layers[k].input >= 0)
+      readers[layers[k].input]++;
+
+  /* The value output is read by the caller and must not be merged
+   * away.
+   */
+  if (model->header->value_layer > 0)
+    readers[model->header->value_layer]++;
+
+  /* Executed layer m is built from file layers k and up, with m <= k,
+   * so the table can be compacted in place.
+   */
+  m = 0;
+  for (k = 0; k < num_layers; k++) {
+    struct nn_layer layer = layers[k];
+    int next = k + 1;
+
+    if (layer.input >= 0)
+      layer.input = executed[layer.input];
+
+    if ((layer.type == NN_LAYER_CONV || layer.type == NN_LAYER_FC)
+	&& next < num_layers
+	&& layers[next].type == NN_LAYER_BN
+	&& layers[next].input == k
+	&& readers[k] == 1) {
+      if (!fold_bn(filename, &layer, &layers[next])) {
+	free(layer.owned);
+	free(readers);
+	return 0;
+      }
+      layer.last = next++;
+    }
+    else if (layer.type == NN_LAYER_BN && !bn_to_affine(filename, &layer)) {
+      free(readers);
+      return 0;
+    }
+
+    if ((layer.type == NN_LAYER_CONV || layer.type == NN_LAYER_FC
+	 || layer.type == NN_LAYER_BN)
+	&& next < num_layers
+	&& layers[next].type == NN_LAYER_ACTIVATION
+	&& layers[next].input == layer.last
+	&& readers[layer.last] == 1) {
+      layer.activation = layers[next].activation;
+      layer.last = next++;
+    }
+
+    for (; k < next; k++)
+      executed[k] = m;
+    k--;
+    layers[m++] = layer;
+  }
+
+  model->num_layers = m;
+  if (model->header->value_layer > 0)
+    model->value_layer = executed[model->header->value_layer];
+  else
+    model->value_layer = -1;
+  free(readers);
+  return 1;
+}
+
+
+/* Load a network file. Returns NULL, after printing a message to
+ * stderr, if the file cannot be used.
+ */
+struct nn_model *
+nn_model_load(const char *filename)
+{
+  struct nn_model *model = calloc(1, sizeof(*model));
+  int k;
+
+  if (!model) {
+    perror("Couldn't allocate memory for network");
+    return NULL;
+  }
+
+  if (!map_file(filename, model)) {
+    free(model);
+    return NULL;
+  }
+
+  if (!setup_layers(filename, model)
+      || !optimise_layers(filename, model)
+      || !plan_buffers(model)) {
+    nn_model_free(model);
+    return NULL;
+  }
+
+  /* Without fully connected layers every layer works on each point
+   * and its neighbours only, so the network can be run directly on a
+   * board smaller than the one it was made for.
+   */
+  model->fully_convolutional = (model->value_layer < 0);
+  for (k = 0; k < model->num_layers; k++)
+    if (model->layers[k].type == NN_LAYER_FC)
+      model->fully_convolutional = 0;
+
+  return model;
+}
+
+
+void
+nn_model_free(struct nn_model *model)
+{
+  if (!model)
+    return;
+  unmap_file(model);
+  if (model->layers) {
+    int k;
+    for (k = 0; k < model->num_layers; k++)
+      free(model->layers[k].owned);
+    free(model->layers);
+  }
+  free(model);
+}
+
+
+const char *
+nn_layer_type_name(int type)
+{
+  static const char *type_names[] = {
+    "?", "conv", "fc", "activation", "softmax", "bn"
+  };
+
+  if (type < NN_LAYER_CONV || type > NN_LAYER_BN)
+    return type_names[0];
+  return type_names[type];
+}
+
+
+/* Memory used by the weights and biases of the executed layers. */
+size_t
+nn_weight_bytes(const struct nn_model *model)
+{
+  size_t bytes = 0;
+  int k;
+
+  for (k = 0; k < model->num_layers; k++) {
+    const struct nn_layer *layer = &model->layers[k];
+    size_t count = layer->desc->weights_count;
+
+    if (layer->type == NN_LAYER_BN)
+      count = 2 * layer->out_planes;
+    if (layer->half_weights)
+      bytes += count * sizeof(unsigned short);
+    else if (layer->weights)
+      bytes += count * sizeof(float);
+    if (layer->bias)
+      bytes += layer->out_planes * sizeof(float);
+  }
+
+  return bytes;
+}
+
+
+/* Print a one line per layer summary of the network as it is
+ * executed, after the load time optimisations.
+ */
+void
+nn_model_describe(const struct nn_model *model, FILE *outfile)
+{
+  static const char *activation_names[] = {
+    "none", "relu", "tanh", "sigmoid"
+  };
+  int k;
+
+  fprintf(outfile, "network: %d layers, %d input planes, %dx%d, %lu bytes%s\n",
+	  model->header->num_layers, model->header->input_planes,
+	  model->header->board_size, model->header->board_size,
+	  (unsigned long) model->size, model->mapped ? " (mapped)" : "");
+  fprintf(outfile, "executed as %d layers, %d buffers of %d floats per sample\n",
+	  model->num_layers, model->num_buffers, model->buffer_floats);
+  fprintf(outfile, "weights: %lu bytes\n",
+	  (unsigned long) nn_weight_bytes(model));
+  if (model->value_layer >= 0)
+    fprintf(outfile, "value head: layer %d\n", model->value_layer);
+  if (model->fully_convolutional)
+    fprintf(outfile, "fully convolutional, runs at the board size\n");
+
+  for (k = 0; k < model->num_layers; k++) {
+    const struct nn_layer *layer = &model->layers[k];
+    fprintf(outfile, "%3d %-10s in=%-3d %3d -> %-3d", k,
+	    nn_layer_type_name(layer->type), layer->input,
+	    layer->in_planes, layer->out_planes);
+    if (layer->type == NN_LAYER_CONV)
+      fprintf(outfile, " kernel %dx%d", layer->kernel, layer->kernel);
+    if (layer->half_weights)
+      fprintf(outfile, " fp16");
+    if (layer->folded_bn)
+      fprintf(outfile, " +bn");
+    if (layer->activation != NN_ACT_NONE)
+      fprintf(outfile, " +%s", activation_names[layer->activation]);
+    if (layer->first == layer->last)
+      fprintf(outfile, " [file layer %d]", layer->first);
+    else
+      fprintf(outfile, " [file layers %d-%d]", layer->first, layer->last);
+    if (layer->buffer >= 0)
+      fprintf(outfile, " -> buffer %d\n", layer->buffer);
+    else
+      fprintf(outfile, " -> output\n");
+  }
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
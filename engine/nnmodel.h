@@ -0,0 +1,300 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _NNMODEL_H_
+#define _NNMODEL_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * Binary network file format ("DGNN" files).
+ *
+ * A network file is laid out so that it can be mapped read-only into
+ * memory and used in place. The weights are not parsed; loading
+ * validates the header and the layer table, so the startup cost
+ * hardly depends on the size of the network, and all engine processes
+ * on a host share the weights through the page cache. Only layers
+ * whose weights are rewritten by the load time optimisations (batch
+ * normalisation folded into a convolution) get private copies.
+ *
+ *   offset 0                    struct nn_file_header
+ *   offset header_size          num_layers * struct nn_layer_desc
+ *   NN_MODEL_ALIGN aligned      weight and bias tensors (float32, or
+ *                               float16 convolution weights)
+ *
+ * All fields are stored in the byte order of the machine which
+ * produced the file. The byte_order field lets the loader reject
+ * files written on a machine with different endianness. Every tensor
+ * starts at an offset which is a multiple of NN_MODEL_ALIGN, so that
+ * the convolution kernels can use aligned vector loads.
+ *
+ * Convolution weights may be stored as IEEE half precision values,
+ * which halves the memory and bandwidth they need. They are converted
+ * to float as the convolution runs and all arithmetic is done in
+ * single precision. Version 1 files have no weights_format field and
+ * are read as float32 throughout.
+ *
+ * Files are produced from DeepCL weight files by the deepcl2nn
+ * program (engine/deepcl2nn.c).
+ */
+
+#define NN_MODEL_MAGIC       "DGNN"
+#define NN_MODEL_VERSION     2
+#define NN_MODEL_BYTE_ORDER  0x01020304
+#define NN_MODEL_ALIGN       64
+
+/* Round up an offset to the tensor alignment. */
+#define NN_ALIGN_UP(x) \
+  (((x) + NN_MODEL_ALIGN - 1) & ~((size_t) NN_MODEL_ALIGN - 1))
+
+/* Input feature sets. The feature set is a property of the network,
+ * since it decides which planes it was trained on.
+ *
+ * NN_FEATURES_KGSGO: the 7 planes of kgsgo-dataset-preprocessor, seen
+ * from the side to move:
+ *   0-2  own stones in strings with 1, 2 and 3+ liberties
+ *   3-5  opponent stones in strings with 1, 2 and 3+ liberties
+ *   6    illegal ko recapture
+ *
+ * NN_FEATURES_KGSGO_LADDER: the 7 planes above plus two ladder planes
+ * computed by ladder_features() in reading.c:
+ *   7    moves which capture an opponent string in a ladder
+ *   8    moves which escape a ladder
+ */
+#define NN_FEATURES_KGSGO         0
+#define NN_FEATURES_KGSGO_LADDER  1
+#define NN_KGSGO_PLANES           7
+#define NN_KGSGO_LADDER_PLANES    9
+
+enum nn_layer_type {
+  NN_LAYER_CONV = 1,   /* 2D convolution with zero padding, plus bias */
+  NN_LAYER_FC,         /* fully connected layer, plus bias */
+  NN_LAYER_ACTIVATION, /* elementwise activation function */
+  NN_LAYER_SOFTMAX,    /* softmax over all outputs of the input layer */
+  NN_LAYER_BN          /* batch normalisation, per plane */
+};
+
+/* The weights of an NN_LAYER_BN layer are 4 rows of out_planes
+ * floats: gamma, beta, running mean and running variance. The layer
+ * computes gamma * (x - mean) / sqrt(variance + NN_BN_EPSILON) + beta.
+ */
+#define NN_BN_EPSILON 1e-5
+
+/* Largest convolution kernel supported. */
+#define NN_MAX_KERNEL 19
+
+/* Storage of a layer's weights. Biases are always float32. */
+enum nn_weights_format {
+  NN_WEIGHTS_FLOAT32 = 0,
+  NN_WEIGHTS_FLOAT16      /* convolution weights only */
+};
+
+enum nn_activation {
+  NN_ACT_NONE = 0,
+  NN_ACT_RELU,
+  NN_ACT_TANH,
+  NN_ACT_SIGMOID
+};
+
+/* File header, 64 bytes. */
+struct nn_file_header {
+  char magic[4];          /* NN_MODEL_MAGIC, not NUL terminated */
+  int version;            /* NN_MODEL_VERSION */
+  unsigned int byte_order;/* NN_MODEL_BYTE_ORDER as written */
+  int header_size;        /* sizeof(struct nn_file_header) */
+  int layer_desc_size;    /* sizeof(struct nn_layer_desc) */
+  int num_layers;
+  int feature_set;        /* NN_FEATURES_* */
+  int input_planes;
+  int board_size;         /* board size the network was trained on */
+  unsigned int file_size; /* total size, used to detect truncation */
+  int value_layer;        /* layer giving the value head, 0 if none */
+  int reserved[5];
+};
+
+/* One entry of the layer table, 64 bytes. Layers are stored in
+ * evaluation order. The output of the last layer is the policy
+ * output, one value per board vertex. Networks with a value head name
+ * the layer whose single output estimates the outcome for the side to
+ * move, from -1 (loss) to 1 (win), in the header.
+ */
+struct nn_layer_desc {
+  int type;               /* enum nn_layer_type */
+  int activation;         /* enum nn_activation, for NN_LAYER_ACTIVATION */
+  int input;              /* index of the layer whose output is read,
+			   * -1 for the input planes */
+  int in_planes;
+  int out_planes;         /* for NN_LAYER_FC the number of outputs */
+  int kernel;             /* convolution kernel size, odd */
+  unsigned int weights_offset;  /* 0 if the layer has no weights */
+  unsigned int bias_offset;     /* 0 if the layer has no bias */
+  unsigned int weights_count;   /* number of values */
+  unsigned int bias_count;
+  int weights_format;     /* enum nn_weights_format */
+  int reserved[5];
+};
+
+/* A network loaded into memory, as it is executed. The layers of the
+ * file are optimised at load time: batch normalisation following a
+ * convolution or fully connected layer is folded into its weights,
+ * and an activation following a convolution, fully connected or batch
+ * normalisation layer is applied in its epilogue. Each executed layer
+ * thus stands for the file layers first..last. The tensors point into
+ * the mapped file, except for folded layers which own theirs.
+ */
+struct nn_layer {
+  const struct nn_layer_desc *desc;  /* file layer first */
+  int type;               /* enum nn_layer_type */
+  int activation;         /* enum nn_activation, applied to the output */
+  int input;              /* index of the executed layer whose output
+			   * is read, -1 for the input planes */
+  int in_planes;
+  int out_planes;
+  int kernel;
+  int first;              /* range of file layers merged into this one */
+  int last;
+  int folded_bn;          /* 1 if a batch normalisation was folded in */
+  const float *weights;
+  const unsigned short *half_weights; /* instead of weights if the
+				       * layer has float16 weights */
+  const float *bias;
+  void *owned;            /* weights and bias allocated at load time */
+  int in_size;            /* spatial size (points per plane) of the input */
+  int out_size;           /* spatial size of the output */
+  int buffer;             /* activation buffer holding the output, or -1
+			   * for the last layer, which writes the result */
+};
+
+struct nn_model {
+  const char *base;       /* start of the file contents */
+  size_t size;
+  int mapped;             /* 1 if base was obtained with mmap() */
+  const struct nn_file_header *header;
+  int num_layers;          /* executed layers */
+  struct nn_layer *layers;
+  int value_layer;        /* executed layer giving the value, -1 if none */
+  int fully_convolutional; /* 1 if it can run on smaller boards */
+  int num_buffers;        /* activation buffers needed by the plan */
+  int buffer_floats;      /* size of each buffer, per sample */
+};
+
+struct nn_model *nn_model_load(const char *filename);
+void nn_model_free(struct nn_model *model);
+void nn_model_describe(const struct nn_model *model, FILE *outfile);
+const char *nn_layer_type_name(int type);
+size_t nn_weight_bytes(const struct nn_model *model);
+
+/* nnhalf.c */
+unsigned short nn_float_to_half(float f);
+float nn_half_to_float(unsigned short h);
+void nn_half_to_float_array(const unsigned short *in, float *out, int count);
+
+/* nneval.c */
+
+/* Preallocated memory for running a network on up to max_batch
+ * samples: the activation buffers of the model's buffer plan and room
+ * for the caller's input planes and output. Every thread that runs
+ * networks uses its own arena, so the evaluation itself never
+ * allocates memory.
+ */
+struct nn_arena {
+  int max_batch;
+  int num_buffers;
+  int buffer_floats;
+  int input_floats;       /* per sample */
+  int output_floats;      /* per sample */
+  float *buffers;
+  float *input;
+  float *output;
+  float *value;           /* max_batch values */
+};
+
+int nn_feature_planes(int feature_set);
+void nn_encode_features(int feature_set, int color, int rot, int n,
+			float *planes);
+int nn_eval_size(const struct nn_model *model, int size);
+int nn_input_size(const struct nn_model *model, int n);
+int nn_output_size(const struct nn_model *model, int n);
+struct nn_arena *nn_arena_new(const struct nn_model *model, int max_batch);
+void nn_arena_free(struct nn_arena *arena);
+int nn_arena_fits(const struct nn_arena *arena, const struct nn_model *model,
+		  int batch);
+void nn_forward_batch(const struct nn_model *model, struct nn_arena *arena,
+		      int n, int batch, const float *input, float *output,
+		      float *value);
+const struct nn_model *nn_current_network(void);
+
+/* States of a background network reload. */
+#define NN_RELOAD_IDLE     0  /* no reload requested */
+#define NN_RELOAD_LOADING  1  /* the file is being loaded */
+#define NN_RELOAD_READY    2  /* loaded, waiting to be swapped in */
+#define NN_RELOAD_DONE     3  /* the new network is in use */
+#define NN_RELOAD_FAILED   4  /* the file could not be loaded */
+
+struct nn_reload_status {
+  int state;
+  char filename[1024];
+  double load_seconds;    /* reading and preparing the file */
+  double swap_seconds;    /* replacing the network, clearing the cache */
+};
+
+int nn_start_reload(const char *filename);
+void nn_get_reload_status(struct nn_reload_status *status);
+void nn_set_profiling(int enable);
+double nn_layer_time(int layer);
+
+/* Largest number of samples run through the network at once by
+ * nn_batch_evaluate().
+ */
+#define NN_MAX_BATCH 64
+
+struct nn_batch_stats {
+  unsigned long batches;
+  unsigned long evaluations;
+  unsigned long batch_size[NN_MAX_BATCH + 1];
+};
+
+void nn_batch_get_stats(struct nn_batch_stats *stats);
+
+/* nnpool.c */
+
+/* Most threads a single evaluation is split over. */
+#define NN_MAX_THREADS 64
+
+typedef void (*nn_pool_task)(void *arg, int index);
+
+void nn_pool_run(int tasks, nn_pool_task task, void *arg);
+int nn_pool_threads(void);
+void nn_pool_shutdown(void);
+
+
+#endif  /* _NNMODEL_H_ */
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,230 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Thread pool for splitting the work of a single network layer.
+ *
+ * nn_pool_run() divides a job into a number of independent tasks and
+ * returns when all of them are done, which is the barrier between two
+ * layers. The calling thread takes part in the work, so with
+ * nn_threads set to t there are t - 1 worker threads. They are started
+ * on first use and then sleep between jobs, so no threads are created
+ * while evaluating. The pool is restarted if nn_threads changes.
+ *
+ * The pool is independent of batching (see nn_batch_add()): large
+ * batches are parallel across positions, the pool lowers the latency
+ * of a single evaluation.
+ */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "liberty.h"
+#include "nnmodel.h"
+#include "gg_utils.h"
+#include "gg_thread.h"
+
+
+#if HAVE_PTHREAD
+
+/* Held by the thread running a job, so that jobs from different
+ * threads are run one at a time.
+ */
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static pthread_t workers[NN_MAX_THREADS];
+static int num_workers = 0;
+static int pool_threads = 1;    /* nn_threads the pool was started for */
+static int pool_stop = 0;
+
+/* The current job. */
+static unsigned long generation = 0;
+static nn_pool_task job_task;
+static void *job_arg;
+static int job_tasks;
+static int next_task;
+static int tasks_left;
+
+
+/* Run tasks of the current job until none are left to start. Called
+ * with pool_lock held.
+ */
+static void
+run_tasks(void)
+{
+  while (next_task < job_tasks) {
+    int index = next_task++;
+    pthread_mutex_unlock(&pool_lock);
+    job_task(job_arg, index);
+    pthread_mutex_lock(&pool_lock);
+    if (--tasks_left == 0)
+      pthread_cond_broadcast(&job_done);
+  }
+}
+
+
+static void *
+worker_loop(void *arg)
+{
+  unsigned long seen;
+  UNUSED(arg);
+
+  pthread_mutex_lock(&pool_lock);
+  seen = generation;
+  while (1) {
+    while (generation == seen && !pool_stop)
+      pthread_cond_wait(&job_ready, &pool_lock);
+    if (pool_stop)
+      break;
+    seen = generation;
+    run_tasks();
+  }
+  pthread_mutex_unlock(&pool_lock);
+
+  return NULL;
+}
+
+
+static void
+stop_workers(void)
+{
+  int k;
+
+  pthread_mutex_lock(&pool_lock);
+  pool_stop = 1;
+  pthread_cond_broadcast(&job_ready);
+  pthread_mutex_unlock(&pool_lock);
+
+  for (k = 0; k < num_workers; k++)
+    pthread_join(workers[k], NULL);
+  num_workers = 0;
+  pool_stop = 0;
+}
+
+
+/* Start workers for a pool of the given number of threads. If not all
+ * of them can be created, the pool just runs with fewer.
+ */
+static void
+start_workers(int threads)
+{
+  while (num_workers < threads - 1) {
+    if (pthread_create(&workers[num_workers], NULL, worker_loop, NULL) != 0)
+      break;
+    num_workers++;
+  }
+  pool_threads = threads;
+}
+
+
+/* Run task(arg, k) for k = 0 .. tasks - 1, spread over the pool, and
+ * return when all of them have finished.
+ */
+void
+nn_pool_run(int tasks, nn_pool_task task, void *arg)
+{
+  int threads = nn_pool_threads();
+  int k;
+
+  if (threads <= 1 || tasks <= 1) {
+    for (k = 0; k < tasks; k++)
+      task(arg, k);
+    return;
+  }
+
+  pthread_mutex_lock(&run_lock);
+  if (threads != pool_threads) {
+    stop_workers();
+    start_workers(threads);
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  job_task = task;
+  job_arg = arg;
+  job_tasks = tasks;
+  next_task = 0;
+  tasks_left = tasks;
+  generation++;
+  pthread_cond_broadcast(&job_ready);
+
+  run_tasks();
+  while (tasks_left > 0)
+    pthread_cond_wait(&job_done, &pool_lock);
+  pthread_mutex_unlock(&pool_lock);
+  pthread_mutex_unlock(&run_lock);
+}
+
+
+/* Stop the worker threads. They are started again by the next job. */
+void
+nn_pool_shutdown(void)
+{
+  pthread_mutex_lock(&run_lock);
+  stop_workers();
+  pool_threads = 1;
+  pthread_mutex_unlock(&run_lock);
+}
+
+
+#else /* !HAVE_PTHREAD */
+
+/* Without threads all tasks are run by the caller. */
+void
+nn_pool_run(int tasks, nn_pool_task task, void *arg)
+{
+  int k;
+  for (k = 0; k < tasks; k++)
+    task(arg, k);
+}
+
+
+void
+nn_pool_shutdown(void)
+{
+}
+
+#endif
+
+
+/* Number of threads jobs are split over, including the caller. */
+int
+nn_pool_threads(void)
+{
+#if HAVE_PTHREAD
+  return gg_max(1, gg_min(nn_threads, NN_MAX_THREADS));
+#else
+  return 1;
+#endif
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
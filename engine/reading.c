@@ -305,8 +305,8 @@ static int in_list(int move, int num_moves, int *moves);
 
 
 /* Statistics. */
-static int reading_node_counter = 0;
-static int nodes_when_called = 0;
+static BOARD_LOCAL int reading_node_counter = 0;
+static BOARD_LOCAL int nodes_when_called = 0;
 
  
 
@@ -1274,8 +1274,8 @@ fast_defense(int str, int liberties, int *libs, int *move)
    * compilers warn, quite correctly, that -1 is not an unsigned
    * number.
    */
-  static unsigned liberty_mark = ~0U;
-  static unsigned lm[BOARDMAX];
+  static BOARD_LOCAL unsigned liberty_mark = ~0U;
+  static BOARD_LOCAL unsigned lm[BOARDMAX];
 
   ASSERT1(libs != NULL, str);
   ASSERT1(move != NULL, str);
@@ -5388,8 +5388,8 @@ tune_move_ordering(int params[MOVE_ORDERING_PARAMETERS])
 /* ================================================================ */
 
 
-static int safe_move_cache[BOARDMAX][2];
-static int safe_move_cache_when[BOARDMAX][2];
+static BOARD_LOCAL int safe_move_cache[BOARDMAX][2];
+static BOARD_LOCAL int safe_move_cache_when[BOARDMAX][2];
 static void clear_safe_move_cache(void);
 
 static void
@@ -5415,7 +5415,7 @@ int
 safe_move(int move, int color)
 {
   int safe = 0;
-  static int initialized = 0;
+  static BOARD_LOCAL int initialized = 0;
   int ko_move;
   
   if (!initialized) {
@@ -5723,6 +5723,44 @@ simple_ladder_defend(int str, int *move)
 }
 
 
+/* Read all ladders on the board for color to move, for the input
+ * features of the network (nneval.c). capture[] is set at the moves
+ * which start a working ladder against an opponent string with two
+ * liberties, escape[] at the moves which save a string of color in
+ * atari from the ladder. Each string is read once, with the strict
+ * ladder reader above, so this is fast enough to be done for every
+ * network evaluation.
+ *
+ * Ladders can run across the whole board, so nothing is read if the
+ * reading stack is already too deep for that.
+ */
+void
+ladder_features(int color, signed char capture[BOARDMAX],
+		signed char escape[BOARDMAX])
+{
+  int strings[MAX_BOARD * MAX_BOARD];
+  int num_strings;
+  int move;
+  int k;
+
+  memset(capture, 0, BOARDMAX);
+  memset(escape, 0, BOARDMAX);
+
+  if (stackp + 4 * board_size >= MAXSTACK - 2)
+    return;
+
+  num_strings = find_lowlib_strings(OTHER_COLOR(color), 2, strings);
+  for (k = 0; k < num_strings; k++)
+    if (simple_ladder(strings[k], &move) == WIN)
+      capture[move] = 1;
+
+  num_strings = find_lowlib_strings(color, 1, strings);
+  for (k = 0; k < num_strings; k++)
+    if (simple_ladder_defend(strings[k], &move) == WIN)
+      escape[move] = 1;
+}
+
+
 /*
  * Local Variables:
  * tab-width: 8
@@ -44,6 +44,9 @@ void load_and_analyze_sgf_file(Gameinfo *gameinfo);
 void load_and_score_sgf_file(SGFTree *tree, Gameinfo *gameinfo,
 			     const char *scoringmode);
 
+void nn_benchmark(const char *path, FILE *out);
+int perft_benchmark(const char *golden_file, FILE *out);
+
 
 #endif
 
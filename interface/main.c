@@ -55,6 +55,7 @@
 #include "interface.h"
 #include "sgftree.h"
 #include "random.h"
+#include "nnmodel.h"
 
 static void show_copyright(void);
 static void show_version(void);
@@ -148,7 +149,19 @@ enum {OPT_BOARDSIZE = 127,
       OPT_MONTE_CARLO,
       OPT_MC_GAMES_PER_LEVEL,
       OPT_MC_PATTERNS,
-      OPT_MC_LOAD_PATTERNS
+      OPT_MC_LOAD_PATTERNS,
+      OPT_NN_MODEL,
+      OPT_NN_CACHE_SIZE,
+      OPT_NN_CACHE_INVARIANT,
+      OPT_NN_BATCH_SIZE,
+      OPT_NN_SYMMETRY,
+      OPT_NN_BENCHMARK,
+      OPT_NN_DUMP_GRAPH,
+      OPT_NN_VALUE_LAMBDA,
+      OPT_NN_POLICY_GENMOVE,
+      OPT_NN_TEMPERATURE,
+      OPT_NN_THREADS,
+      OPT_PERFT
 };
 
 /* names of playing modes */
@@ -165,6 +178,8 @@ enum mode {
   MODE_LOAD_AND_PRINT,
   MODE_SOLO,
   MODE_REPLAY,
+  MODE_NN_BENCHMARK,
+  MODE_PERFT,
 };
 
 
@@ -255,6 +270,7 @@ static struct gg_option const long_options[] =
   {"worms",          no_argument,       0, 'w'},
   {"moyo",           required_argument, 0, 'm'},
   {"benchmark",      required_argument, 0, 'b'},
+  {"perft",          required_argument, 0, OPT_PERFT},
   {"statistics",     no_argument,       0, 'S'},
   {"trace",          no_argument,       0, 't'},
   {"seed",           required_argument, 0, 'r'},
@@ -275,6 +291,17 @@ static struct gg_option const long_options[] =
   {"mc-games-per-level", required_argument, 0, OPT_MC_GAMES_PER_LEVEL},
   {"mc-patterns",    required_argument, 0, OPT_MC_PATTERNS},
   {"mc-load-patterns", required_argument, 0, OPT_MC_LOAD_PATTERNS},
+  {"nn-model",       required_argument, 0, OPT_NN_MODEL},
+  {"nn-cache-size",  required_argument, 0, OPT_NN_CACHE_SIZE},
+  {"nn-cache-invariant", no_argument,   0, OPT_NN_CACHE_INVARIANT},
+  {"nn-batch-size",  required_argument, 0, OPT_NN_BATCH_SIZE},
+  {"nn-symmetry",    required_argument, 0, OPT_NN_SYMMETRY},
+  {"nn-benchmark",   required_argument, 0, OPT_NN_BENCHMARK},
+  {"nn-dump-graph",  no_argument,       0, OPT_NN_DUMP_GRAPH},
+  {"nn-value-lambda", required_argument, 0, OPT_NN_VALUE_LAMBDA},
+  {"nn-policy-genmove", no_argument,    0, OPT_NN_POLICY_GENMOVE},
+  {"nn-temperature", required_argument, 0, OPT_NN_TEMPERATURE},
+  {"nn-threads",     required_argument, 0, OPT_NN_THREADS},
   {NULL, 0, NULL, 0}
 };
 
@@ -307,6 +334,9 @@ main(int argc, char *argv[])
   char debuginfluence_move[4] = "\0";
   
   int benchmark = 0;  /* benchmarking mode (-b) */
+  char *nn_benchmark_path = NULL;
+  char *perft_file = NULL;
+  int nn_dump_graph = 0;
   FILE *output_check;
   int orientation = 0;
 
@@ -630,6 +660,82 @@ main(int argc, char *argv[])
 	strcpy(mc_pattern_filename, gg_optarg);
 	break;
 
+      case OPT_NN_MODEL:
+	if (!nn_load_network(gg_optarg)) {
+	  fprintf(stderr, "Cannot load network '%s'\n", gg_optarg);
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_NN_CACHE_SIZE:
+	nn_cache_size = atof(gg_optarg);
+	break;
+
+      case OPT_NN_CACHE_INVARIANT:
+	nn_cache_invariant = 1;
+	break;
+
+      case OPT_NN_BATCH_SIZE:
+	nn_batch_size = atoi(gg_optarg);
+	break;
+
+      case OPT_NN_SYMMETRY:
+	if (strcmp(gg_optarg, "none") == 0)
+	  nn_set_symmetry(NN_SYMMETRY_NONE);
+	else if (strcmp(gg_optarg, "random") == 0)
+	  nn_set_symmetry(NN_SYMMETRY_RANDOM);
+	else if (strcmp(gg_optarg, "full") == 0)
+	  nn_set_symmetry(NN_SYMMETRY_FULL);
+	else {
+	  fprintf(stderr, "Invalid symmetry mode: %s\n", gg_optarg);
+	  fprintf(stderr, "Try `gnugo --help' for more information.\n");
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_NN_BENCHMARK:
+	nn_benchmark_path = gg_optarg;
+	playmode = MODE_NN_BENCHMARK;
+	break;
+
+      case OPT_PERFT:
+	perft_file = gg_optarg;
+	playmode = MODE_PERFT;
+	break;
+
+      case OPT_NN_DUMP_GRAPH:
+	nn_dump_graph = 1;
+	break;
+
+      case OPT_NN_VALUE_LAMBDA:
+	nn_value_lambda = atof(gg_optarg);
+	if (nn_value_lambda < 0.0 || nn_value_lambda > 1.0) {
+	  fprintf(stderr, "The value lambda must be between 0 and 1.\n");
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_NN_POLICY_GENMOVE:
+	nn_policy_genmove = 1;
+	break;
+
+      case OPT_NN_TEMPERATURE:
+	nn_temperature = atof(gg_optarg);
+	if (nn_temperature < 0.0) {
+	  fprintf(stderr, "The temperature must not be negative.\n");
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
+      case OPT_NN_THREADS:
+	nn_threads = atoi(gg_optarg);
+	if (nn_threads < 1 || nn_threads > NN_MAX_THREADS) {
+	  fprintf(stderr, "The number of network threads must be between 1 and %d.\n",
+		  NN_MAX_THREADS);
+	  exit(EXIT_FAILURE);
+	}
+	break;
+
       case OPT_MODE: 
 	if (strcmp(gg_optarg, "ascii") == 0)
 	  playmode = MODE_ASCII;
@@ -846,6 +952,12 @@ main(int argc, char *argv[])
   /* Initialize the GNU Go engine. */
   init_gnugo(memory, seed);
 
+  /* Show the network as it is executed, after the load time
+   * optimisations.
+   */
+  if (nn_dump_graph && nn_have_network())
+    nn_model_describe(nn_current_network(), stderr);
+
   /* Read the infile if there is one. Also play up the position. */
   if (infilename) {
     if (!sgftree_readfile(&sgftree, infilename)) {
@@ -909,6 +1021,15 @@ main(int argc, char *argv[])
     }
     play_replay(&sgftree, replay_color);
     break;
+
+  case MODE_NN_BENCHMARK:
+    nn_benchmark(nn_benchmark_path, stdout);
+    break;
+
+  case MODE_PERFT:
+    if (perft_benchmark(perft_file, stdout) > 0)
+      exit(EXIT_FAILURE);
+    break;
     
   case MODE_LOAD_AND_ANALYZE:
     if (mandated_color != EMPTY)
@@ -1160,7 +1281,8 @@ Experimental options:\n\
    --nojosekidb            turn off joseki database\n\
    --mirror                try to play mirror go\n\
    --mirror-limit <n>      stop mirroring when n stones on board\n\n\
-   --monte-carlo           enable Monte Carlo move generation (9x9 or smaller)\n\
+   --monte-carlo           enable Monte Carlo move generation (9x9 or\n\
+                           smaller unless a network is loaded)\n\
    --mc-games-per-level <n> number of Monte Carlo simulations per level\n\
    --mc-list-patterns      list names of builtin Monte Carlo patterns\n\
    --mc-patterns <name>    choose a built in Monte Carlo pattern database\n\
@@ -1185,6 +1307,38 @@ Informative Output:\n\
 \n\
 "
 
+#define USAGE_NN "\
+Neural network options:\n\
+   --nn-model <file>       load a network file (convert DeepCL weights\n\
+                           with deepcl2nn)\n\
+   --nn-cache-size <megabytes>  memory for cached network evaluations\n\
+                           (0 disables the cache)\n\
+   --nn-cache-invariant    share cached evaluations between rotated and\n\
+                           mirrored positions\n\
+   --nn-batch-size <n>     evaluate up to n Monte Carlo leaves together\n\
+                           (default 1, no batching)\n\
+   --nn-threads <n>        split each convolution over n threads to\n\
+                           lower the latency of one evaluation\n\
+                           (default 1)\n\
+   --nn-symmetry <mode>    orientation of positions given to the network:\n\
+                           'none' (default), 'random' or 'full' (average\n\
+                           over all 8)\n\
+   --nn-benchmark <path>   measure speed and move prediction accuracy of\n\
+                           the network over the SGF files in path and\n\
+                           print the results as JSON\n\
+   --nn-dump-graph         print the layers of the network as they are\n\
+                           executed, after batch normalisation folding\n\
+                           and activation fusion\n\
+   --nn-value-lambda <x>   weight of the network's value head against\n\
+                           playouts in Monte Carlo leaves, from 0 (only\n\
+                           playouts) to 1 (only the network, default 0.5)\n\
+   --nn-policy-genmove     play the network's best legal move without any\n\
+                           search\n\
+   --nn-temperature <t>    sample policy moves with probabilities raised\n\
+                           to the power 1/t (default 0, the best move)\n\
+\n\
+"
+
 #define COPYRIGHT \
 "Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007\n\
 2008 and 2009 by the Free Software Foundation, Inc.\n\
@@ -1215,6 +1369,8 @@ Debugging Options:\n\
    -m, --moyo <level>            moyo debugging, show moyo board\n\
        --debug-influence <move>   print influence map after making a move\n\
    -b, --benchmark num           benchmarking mode - can be used with -l\n\
+       --perft <file>            count the move sequences from the positions\n\
+                                 in file and compare with the known counts\n\
    -S, --statistics              print statistics (for debugging purposes)\n\n\
        --profile-patterns        print statistics for pattern usage\n\
        --showtime                print timing diagnostic\n\
@@ -1279,6 +1435,7 @@ show_help(void)
   printf(USAGE1, MIN_BOARD, MAX_BOARD, MAX_HANDICAP);
   printf(USAGE2, DEFAULT_MEMORY <= 0 ? reading_cache_default_size() :
 	 (float) DEFAULT_MEMORY);
+  printf(USAGE_NN);
 }
 
 
@@ -0,0 +1,342 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Benchmark of the policy network over a collection of games.
+ *
+ * Every position of every game is evaluated with the network, and
+ * the move actually played is looked up in the resulting move
+ * ordering. The results, speed and prediction accuracy, plus the time
+ * spent in each layer, are written as a JSON object.
+ */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_DIRENT_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+#include "interface.h"
+#include "liberty.h"
+#include "sgftree.h"
+#include "gg_utils.h"
+#include "nnmodel.h"
+#include "nncache.h"
+
+struct nnbench_result {
+  int games;
+  int failed_games;
+  long positions;
+  long predicted;      /* positions where the game move was on the board */
+  long top1;
+  long top5;
+  double seconds;      /* time spent in the network */
+};
+
+struct file_list {
+  char **names;
+  int count;
+  int size;
+};
+
+
+static void
+add_file(struct file_list *list, const char *name)
+{
+  if (list->count == list->size) {
+    list->size = (list->size == 0 ? 64 : 2 * list->size);
+    list->names = realloc(list->names, list->size * sizeof(char *));
+    if (!list->names) {
+      perror("nnbench");
+      exit(EXIT_FAILURE);
+    }
+  }
+  list->names[list->count] = malloc(strlen(name) + 1);
+  if (!list->names[list->count]) {
+    perror("nnbench");
+    exit(EXIT_FAILURE);
+  }
+  strcpy(list->names[list->count++], name);
+}
+
+
+static int
+has_sgf_suffix(const char *name)
+{
+  size_t len = strlen(name);
+  return (len > 4
+	  && name[len - 4] == '.'
+	  && (name[len - 3] == 's' || name[len - 3] == 'S')
+	  && (name[len - 2] == 'g' || name[len - 2] == 'G')
+	  && (name[len - 1] == 'f' || name[len - 1] == 'F'));
+}
+
+
+/* Collect the SGF files below path, or path itself if it is a file. */
+static void
+collect_files(struct file_list *list, const char *path)
+{
+#if HAVE_DIRENT_H
+  struct stat st;
+  DIR *dir;
+  struct dirent *entry;
+
+  if (stat(path, &st) != 0) {
+    perror(path);
+    return;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    add_file(list, path);
+    return;
+  }
+
+  dir = opendir(path);
+  if (!dir) {
+    perror(path);
+    return;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    char name[1024];
+    struct stat sub;
+
+    if (entry->d_name[0] == '.')
+      continue;
+    gg_snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+    if (stat(name, &sub) != 0)
+      continue;
+    if (S_ISDIR(sub.st_mode))
+      collect_files(list, name);
+    else if (has_sgf_suffix(name))
+      add_file(list, name);
+  }
+  closedir(dir);
+#else
+  /* Without directory support only single files can be given. */
+  add_file(list, path);
+#endif
+}
+
+
+static int
+compare_names(const void *a, const void *b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+/* Evaluate the current position and score the prediction of move. */
+static void
+benchmark_position(int color, int move, struct nnbench_result *result)
+{
+  float policy[BOARDMAX];
+  double start;
+  int rank;
+  int pos;
+
+  start = gg_gettimeofday();
+  if (!nn_evaluate(color, policy, NULL))
+    return;
+  result->seconds += gg_gettimeofday() - start;
+  result->positions++;
+
+  if (!ON_BOARD(move))
+    return;
+
+  rank = 0;
+  for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+    if (ON_BOARD(pos) && policy[pos] > policy[move])
+      rank++;
+
+  result->predicted++;
+  if (rank == 0)
+    result->top1++;
+  if (rank < 5)
+    result->top5++;
+}
+
+
+/* Replay the main line of one game, evaluating the position before
+ * each move.
+ */
+static void
+benchmark_game(const char *filename, struct nnbench_result *result)
+{
+  SGFTree tree;
+  Gameinfo gameinfo;
+
+  sgftree_clear(&tree);
+  gameinfo_clear(&gameinfo);
+  if (!sgftree_readfile(&tree, filename)) {
+    fprintf(stderr, "Cannot open or parse '%s'\n", filename);
+    result->failed_games++;
+    return;
+  }
+
+  /* Set up board size, handicap and setup stones, stopping before
+   * the first move.
+   */
+  if (gameinfo_play_sgftree(&gameinfo, &tree, "1") == EMPTY) {
+    fprintf(stderr, "Cannot load '%s'\n", filename);
+    result->failed_games++;
+    sgfFreeNode(tree.root);
+    return;
+  }
+
+  while (sgftreeForward(&tree)) {
+    SGFProperty *prop;
+
+    for (prop = tree.lastnode->props; prop; prop = prop->next) {
+      int move;
+      int color;
+
+      switch (prop->name) {
+      case SGFAB:
+      case SGFAW:
+	move = get_sgfmove(prop);
+	if (ON_BOARD(move) && board[move] == EMPTY)
+	  add_stone(move, prop->name == SGFAB ? BLACK : WHITE);
+	break;
+
+      case SGFB:
+      case SGFW:
+	move = get_sgfmove(prop);
+	color = (prop->name == SGFW ? WHITE : BLACK);
+	if (!is_pass(move) && !is_allowed_move(move, color))
+	  goto done;
+	benchmark_position(color, move, result);
+	gnugo_play_move(move, color);
+	break;
+      }
+    }
+  }
+
+ done:
+  result->games++;
+  sgfFreeNode(tree.root);
+}
+
+
+static void
+print_json(FILE *out, const char *path, const struct nnbench_result *result)
+{
+  static const char *symmetry_names[] = {"none", "random", "full"};
+  const struct nn_model *model = nn_current_network();
+  double layer_total = 0.0;
+  int k;
+
+  for (k = 0; k < model->num_layers; k++)
+    layer_total += nn_layer_time(k);
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"corpus\": \"");
+  for (; *path; path++) {
+    if (*path == '"' || *path == '\\')
+      fputc('\\', out);
+    fputc(*path, out);
+  }
+  fprintf(out, "\",\n");
+  fprintf(out, "  \"games\": %d,\n", result->games);
+  fprintf(out, "  \"failed_games\": %d,\n", result->failed_games);
+  fprintf(out, "  \"positions\": %ld,\n", result->positions);
+  fprintf(out, "  \"symmetry\": \"%s\",\n", symmetry_names[nn_symmetry]);
+  fprintf(out, "  \"seconds\": %.3f,\n", result->seconds);
+  fprintf(out, "  \"positions_per_second\": %.1f,\n",
+	  result->seconds > 0.0 ? result->positions / result->seconds : 0.0);
+  fprintf(out, "  \"top1_accuracy\": %.4f,\n",
+	  result->predicted > 0 ? (double) result->top1 / result->predicted
+	  : 0.0);
+  fprintf(out, "  \"top5_accuracy\": %.4f,\n",
+	  result->predicted > 0 ? (double) result->top5 / result->predicted
+	  : 0.0);
+  fprintf(out, "  \"weight_bytes\": %lu,\n",
+	  (unsigned long) nn_weight_bytes(model));
+  fprintf(out, "  \"layers\": [");
+  for (k = 0; k < model->num_layers; k++) {
+    const struct nn_layer *layer = &model->layers[k];
+    fprintf(out, "%s\n    {\"index\": %d, \"type\": \"%s\", "
+	    "\"file_layers\": [%d, %d], "
+	    "\"in_planes\": %d, \"out_planes\": %d, \"weights\": \"%s\", "
+	    "\"seconds\": %.4f, \"fraction\": %.4f}",
+	    k > 0 ? "," : "", k, nn_layer_type_name(layer->type),
+	    layer->first, layer->last,
+	    layer->in_planes, layer->out_planes,
+	    layer->half_weights ? "fp16" : (layer->weights ? "fp32" : "none"),
+	    nn_layer_time(k),
+	    layer_total > 0.0 ? nn_layer_time(k) / layer_total : 0.0);
+  }
+  fprintf(out, "\n  ]\n");
+  fprintf(out, "}\n");
+}
+
+
+/* Run the policy benchmark over the SGF files found at path, a file
+ * or a directory which is searched recursively, and print the results
+ * to out.
+ */
+void
+nn_benchmark(const char *path, FILE *out)
+{
+  struct file_list files;
+  struct nnbench_result result;
+  int k;
+
+  if (!nn_have_network()) {
+    fprintf(stderr, "The policy benchmark needs a network (--nn-model).\n");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&files, 0, sizeof(files));
+  memset(&result, 0, sizeof(result));
+  collect_files(&files, path);
+  qsort(files.names, files.count, sizeof(char *), compare_names);
+
+  /* Repeated positions, mainly the empty board, must not be answered
+   * from the cache.
+   */
+  nn_cache_init(0);
+  nn_set_profiling(1);
+
+  for (k = 0; k < files.count; k++) {
+    benchmark_game(files.names[k], &result);
+    free(files.names[k]);
+  }
+  free(files.names);
+
+  print_json(out, path, &result);
+  nn_set_profiling(0);
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,281 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Speed and correctness test of the incremental board, after the
+ * perft ("performance test") of chess programs.
+ *
+ * From a position, every sequence of moves of the given depth is
+ * played with trymove() and taken back with popgo(). The number of
+ * sequences only depends on the rules, so it can be compared against
+ * a known value, and the time needed measures the raw speed of the
+ * board code. While counting, the incrementally updated board hash and
+ * the strings found by find_lowlib_strings() are compared with ones
+ * computed from scratch at every node.
+ *
+ * The positions are listed in a golden file, one per line:
+ *
+ *   <sgf file> <until> <depth> <nodes>
+ *
+ * The game is loaded up to <until>, a move number or a vertex as for
+ * --until, or "end" for the whole game. <nodes> is the expected number
+ * of move sequences, or "-" if it is not yet known. SGF file names are
+ * relative to the directory of the golden file. Empty lines and lines
+ * starting with '#' are ignored.
+ */
+
+#include "gnugo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface.h"
+#include "liberty.h"
+#include "sgftree.h"
+#include "gg_utils.h"
+
+struct perft_count {
+  unsigned long leaves;  /* move sequences of full depth */
+  unsigned long moves;   /* calls to trymove() which succeeded */
+  unsigned long hash_errors;
+  unsigned long lowlib_errors;
+};
+
+
+/* Compare find_lowlib_strings() with the strings of one or two
+ * liberties found on the board. Returns 1 if they agree.
+ */
+static int
+lowlib_strings_ok(void)
+{
+  int strings[BOARDMAX];
+  signed char found[BOARDMAX];
+  int color;
+  int liberties;
+  int pos;
+  int k;
+
+  for (color = WHITE; color <= BLACK; color++)
+    for (liberties = 1; liberties <= 2; liberties++) {
+      int n = find_lowlib_strings(color, liberties, strings);
+      memset(found, 0, sizeof(found));
+      for (k = 0; k < n; k++) {
+	pos = strings[k];
+	if (found[pos] || board[pos] != color || find_origin(pos) != pos
+	    || countlib(pos) != liberties)
+	  return 0;
+	found[pos] = 1;
+      }
+      for (pos = BOARDMIN; pos < BOARD_LAST; pos++)
+	if (board[pos] == color && find_origin(pos) == pos
+	    && countlib(pos) == liberties && !found[pos])
+	  return 0;
+    }
+
+  return 1;
+}
+
+
+/* Count the move sequences of the given depth from the current
+ * position, color to move. Passes are not played, so the sequences
+ * consist of the moves which trymove() accepts: no suicide and no
+ * retaking of a ko.
+ */
+static void
+perft(int color, int depth, int check, struct perft_count *count)
+{
+  int pos;
+
+  if (check) {
+    Hash_data hash;
+    hashdata_recalc(&hash, board, board_ko_pos);
+    if (!hashdata_is_equal(hash, board_hash)) {
+      if (count->hash_errors == 0)
+	showboard(0);
+      count->hash_errors++;
+    }
+    if (!lowlib_strings_ok()) {
+      if (count->lowlib_errors == 0)
+	showboard(0);
+      count->lowlib_errors++;
+    }
+  }
+
+  if (depth == 0) {
+    count->leaves++;
+    return;
+  }
+
+  for (pos = BOARDMIN; pos < BOARD_LAST; pos++) {
+    if (board[pos] != EMPTY)
+      continue;
+    if (trymove(pos, color, "perft", NO_MOVE)) {
+      count->moves++;
+      perft(OTHER_COLOR(color), depth - 1, check, count);
+      popgo();
+    }
+  }
+}
+
+
+/* Set up the position of one golden file entry. Returns the color to
+ * move, or EMPTY if the game could not be loaded.
+ */
+static int
+load_position(const char *filename, const char *until)
+{
+  SGFTree tree;
+  Gameinfo gameinfo;
+  int color;
+
+  sgftree_clear(&tree);
+  gameinfo_clear(&gameinfo);
+  if (!sgftree_readfile(&tree, filename)) {
+    fprintf(stderr, "Cannot open or parse '%s'\n", filename);
+    return EMPTY;
+  }
+
+  if (strcmp(until, "end") == 0)
+    until = NULL;
+  color = gameinfo_play_sgftree(&gameinfo, &tree, until);
+  sgfFreeNode(tree.root);
+  if (color == EMPTY)
+    fprintf(stderr, "Cannot load '%s'\n", filename);
+
+  return color;
+}
+
+
+/* Run the positions of the golden file and print one line per
+ * position with the number of move sequences and the speed. The speed
+ * is measured in a separate pass without the verification.
+ * Returns the number of positions which failed.
+ */
+int
+perft_benchmark(const char *golden_file, FILE *out)
+{
+  FILE *golden;
+  char line[1024];
+  char dir[1024];
+  const char *slash;
+  int line_number = 0;
+  int positions = 0;
+  int failures = 0;
+  unsigned long total_moves = 0;
+  double total_seconds = 0.0;
+
+  golden = fopen(golden_file, "r");
+  if (!golden) {
+    perror(golden_file);
+    return 1;
+  }
+
+  slash = strrchr(golden_file, '/');
+  if (slash)
+    gg_snprintf(dir, sizeof(dir), "%.*s/",
+		(int) (slash - golden_file), golden_file);
+  else
+    dir[0] = '\0';
+
+  while (fgets(line, sizeof(line), golden)) {
+    char sgf[512];
+    char until[64];
+    char expected[64];
+    char filename[1024];
+    int depth;
+    int color;
+    struct perft_count checked;
+    struct perft_count timed;
+    double start;
+    double seconds;
+    int ok;
+
+    line_number++;
+    if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+      continue;
+
+    if (sscanf(line, "%511s %63s %d %63s", sgf, until, &depth, expected) != 4
+	|| depth < 0 || depth >= MAXSTACK - 2) {
+      fprintf(stderr, "%s:%d: malformed line\n", golden_file, line_number);
+      failures++;
+      continue;
+    }
+
+    if (sgf[0] == '/')
+      gg_snprintf(filename, sizeof(filename), "%s", sgf);
+    else
+      gg_snprintf(filename, sizeof(filename), "%s%s", dir, sgf);
+
+    positions++;
+    color = load_position(filename, until);
+    if (color == EMPTY) {
+      failures++;
+      continue;
+    }
+
+    memset(&checked, 0, sizeof(checked));
+    perft(color, depth, 1, &checked);
+
+    memset(&timed, 0, sizeof(timed));
+    start = gg_gettimeofday();
+    perft(color, depth, 0, &timed);
+    seconds = gg_gettimeofday() - start;
+    total_moves += timed.moves;
+    total_seconds += seconds;
+
+    ok = (checked.hash_errors == 0
+	  && checked.lowlib_errors == 0
+	  && timed.leaves == checked.leaves
+	  && (strcmp(expected, "-") == 0
+	      || strtoul(expected, NULL, 10) == checked.leaves));
+    if (!ok)
+      failures++;
+
+    fprintf(out, "%s %s %d %lu", sgf, until, depth, checked.leaves);
+    fprintf(out, "  %.3f s, %.0f moves/s",
+	    seconds, seconds > 0.0 ? timed.moves / seconds : 0.0);
+    if (checked.hash_errors > 0)
+      fprintf(out, "  FAILED: %lu hash errors", checked.hash_errors);
+    else if (checked.lowlib_errors > 0)
+      fprintf(out, "  FAILED: %lu low liberty list errors",
+	      checked.lowlib_errors);
+    else if (!ok)
+      fprintf(out, "  FAILED: expected %s", expected);
+    fprintf(out, "\n");
+  }
+  fclose(golden);
+
+  fprintf(out, "%d positions, %d failed, %.0f moves/s\n",
+	  positions, failures,
+	  total_seconds > 0.0 ? total_moves / total_seconds : 0.0);
+
+  return failures;
+}
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */
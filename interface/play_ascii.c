@@ -161,6 +161,7 @@ set_handicap_spots(int boardsize)
       /* ...and the middle one. */
       hspots[boardsize/2][boardsize/2] = '+';
     }
+#if MAX_BOARD > 12
     else if (boardsize > 12) {
       /* Place the outer 4... */
       hspots[3][3] = '+';
@@ -177,6 +178,7 @@ set_handicap_spots(int boardsize)
       /* ...and the middle one. */
       hspots[boardsize/2][boardsize/2] = '+';
     }
+#endif
   }
 
   return;
@@ -33,6 +33,8 @@
 #include "liberty.h"
 #include "gtp.h"
 #include "gg_utils.h"
+#include "nncache.h"
+#include "nnmodel.h"
 
 /* Internal state that's not part of the engine. */
 static int report_uncertainty = 0;
@@ -96,6 +98,12 @@ DECLARE(gtp_move_probabilities);
 DECLARE(gtp_move_uncertainty);
 DECLARE(gtp_move_history);
 DECLARE(gtp_name);
+DECLARE(gtp_nn_batch_stats);
+DECLARE(gtp_nn_cache_stats);
+DECLARE(gtp_nn_load);
+DECLARE(gtp_nn_load_status);
+DECLARE(gtp_nn_symmetry);
+DECLARE(gtp_ownership);
 DECLARE(gtp_play);
 DECLARE(gtp_playblack);
 DECLARE(gtp_playwhite);
@@ -130,6 +138,7 @@ DECLARE(gtp_trymove);
 DECLARE(gtp_tune_move_ordering);
 DECLARE(gtp_undo);
 DECLARE(gtp_what_color);
+DECLARE(gtp_winrate);
 
 /* List of known commands. */
 static struct gtp_command commands[] = {
@@ -188,7 +197,13 @@ static struct gtp_command commands[] = {
   {"move_history",	      gtp_move_history},
   {"name",                    gtp_name},
   {"new_score",               gtp_estimate_score},
+  {"nn_batch_stats",          gtp_nn_batch_stats},
+  {"nn_cache_stats",          gtp_nn_cache_stats},
+  {"nn_load",                 gtp_nn_load},
+  {"nn_load_status",          gtp_nn_load_status},
+  {"nn_symmetry",             gtp_nn_symmetry},
   {"orientation",     	      gtp_set_orientation},
+  {"ownership",               gtp_ownership},
   {"play",            	      gtp_play},
   {"popgo",            	      gtp_popgo},
   {"printsgf",         	      gtp_printsgf},
@@ -216,6 +231,7 @@ static struct gtp_command commands[] = {
   {"undo",                    gtp_undo},
   {"version",                 gtp_program_version},
   {"white",            	      gtp_playwhite},
+  {"winrate",                 gtp_winrate},
   {NULL,                      NULL}
 };
 
@@ -856,6 +872,7 @@ gtp_all_legal(char *s)
 {
   int i, j;
   int color;
+  signed char allowed[BOARDMAX];
   int movei[MAX_BOARD * MAX_BOARD];
   int movej[MAX_BOARD * MAX_BOARD];
   int moves = 0;
@@ -863,9 +880,10 @@ gtp_all_legal(char *s)
   if (!gtp_decode_color(s, &color))
     return gtp_failure("invalid color");
 
+  find_allowed_moves(color, allowed, 0);
   for (i = 0; i < board_size; i++)
     for (j = 0; j < board_size; j++)
-      if (BOARD(i, j) == EMPTY && is_allowed_move(POS(i, j), color)) {
+      if (allowed[POS(i, j)]) {
 	movei[moves] = i;
 	movej[moves++] = j;
       }
@@ -1076,9 +1094,144 @@ gtp_clear_cache(char *s)
 {
   UNUSED(s);
   reading_cache_clear();
+  nn_cache_clear();
   return gtp_success("");
 }
 
+
+/* Function:  Report statistics for the network evaluation cache.
+ * Arguments: none.
+ * Fails:     never.
+ * Returns:   Number of lookups, hits, hit rate in percent, number of
+ *            stored evaluations and number of entries, one per line.
+ */
+
+static int
+gtp_nn_cache_stats(char *s)
+{
+  struct nn_cache_stats stats;
+  UNUSED(s);
+
+  nn_cache_get_stats(&stats);
+  gtp_start_response(GTP_SUCCESS);
+  gtp_printf("lookups %lu\n", stats.lookups);
+  gtp_printf("hits %lu\n", stats.hits);
+  gtp_printf("hit_rate %.1f\n",
+	     stats.lookups > 0 ? 100.0 * stats.hits / stats.lookups : 0.0);
+  gtp_printf("stores %lu\n", stats.stores);
+  gtp_printf("entries %d", nn_cache_num_entries());
+  return gtp_finish_response();
+}
+
+
+/* Function:  Report the histogram of batch sizes of network
+ *            evaluations.
+ * Arguments: none.
+ * Fails:     never.
+ * Returns:   Number of batches and evaluated positions, then one line
+ *            "size <n> <count>" per nonempty histogram bucket.
+ */
+
+static int
+gtp_nn_batch_stats(char *s)
+{
+  struct nn_batch_stats stats;
+  int k;
+  UNUSED(s);
+
+  nn_batch_get_stats(&stats);
+  gtp_start_response(GTP_SUCCESS);
+  gtp_printf("batches %lu\n", stats.batches);
+  gtp_printf("evaluations %lu", stats.evaluations);
+  for (k = 1; k <= NN_MAX_BATCH; k++)
+    if (stats.batch_size[k] > 0)
+      gtp_printf("\nsize %d %lu", k, stats.batch_size[k]);
+  return gtp_finish_response();
+}
+
+/*******************
+ * Neural network. *
+ *******************/
+
+/* Function:  Start loading a new network file in the background. The
+ *            current network stays in use until the new one is ready;
+ *            it is then swapped in before the next search or by
+ *            nn_load_status. Game state is kept.
+ * Arguments: filename
+ * Fails:     missing filename, a reload already in progress
+ * Returns:   nothing
+ */
+static int
+gtp_nn_load(char *s)
+{
+  char filename[GTP_BUFSIZE];
+
+  if (sscanf(s, "%s", filename) < 1)
+    return gtp_failure("missing filename");
+
+  if (!nn_start_reload(filename))
+    return gtp_failure("network reload already in progress");
+
+  return gtp_success("");
+}
+
+
+/* Function:  Report the progress of the last nn_load, swapping the new
+ *            network in if it is ready.
+ * Arguments: none
+ * Fails:     the network could not be loaded
+ * Returns:   "idle", "loading <filename>" or "loaded <filename>"
+ *            followed by the load and swap times in milliseconds.
+ */
+static int
+gtp_nn_load_status(char *s)
+{
+  struct nn_reload_status status;
+  UNUSED(s);
+
+  nn_swap_network();
+  nn_get_reload_status(&status);
+
+  switch (status.state) {
+  case NN_RELOAD_LOADING:
+  case NN_RELOAD_READY:
+    return gtp_success("loading %s", status.filename);
+  case NN_RELOAD_DONE:
+    return gtp_success("loaded %s load %.1f ms swap %.3f ms", status.filename,
+		       1000.0 * status.load_seconds,
+		       1000.0 * status.swap_seconds);
+  case NN_RELOAD_FAILED:
+    return gtp_failure("could not load %s", status.filename);
+  }
+
+  return gtp_success("idle");
+}
+
+
+/* Function:  Set or query how positions are oriented for the network.
+ * Arguments: optional "none", "random" or "full"
+ * Fails:     invalid argument
+ * Returns:   the current mode if no argument was given, otherwise nothing
+ */
+static int
+gtp_nn_symmetry(char *s)
+{
+  static const char *modes[] = {"none", "random", "full"};
+  char mode[GTP_BUFSIZE];
+  int k;
+
+  if (sscanf(s, "%s", mode) < 1)
+    return gtp_success("%s", modes[nn_symmetry]);
+
+  for (k = 0; k < 3; k++)
+    if (strcmp(mode, modes[k]) == 0) {
+      nn_set_symmetry(k);
+      return gtp_success("");
+    }
+
+  return gtp_failure("invalid symmetry mode");
+}
+
 /*********************
  * Tactical reading. *
  *********************/
@@ -1507,13 +1660,13 @@ gtp_kgs_genmove_cleanup(char *s)
 }
 
 
-/* Function : Generate a list of all moves with values larger than zero in
- *            the previous genmove command.
- *            If no previous genmove command has been issued, the result
- *            of this command will be meaningless.
+/* Function : List prior, visits and win rate of all moves considered in
+ *            the last analysis of the current position.
+ *            If the position has not been analyzed since it last
+ *            changed, the list is empty.
  * Arguments: none
  * Fails:   : never
- * Returns  : list of moves with values
+ * Returns  : list of moves with prior, visits and win rate, one per row
  */
 
 static int
@@ -1521,16 +1674,16 @@ gtp_all_move_values(char *s)
 {
   UNUSED(s);
   gtp_start_response(GTP_SUCCESS);
-//TODO
-//  print_all_move_values(gtp_output_file);
+  print_all_move_values(gtp_output_file);
   gtp_printf("\n");
   return GTP_OK;
 }
 
-/* Function : Generate a sorted list of the best moves in the previous genmove
- *            command.
- *            If no previous genmove command has been issued, the result
- *            of this command will be meaningless.
+/* Function : Generate a sorted list of the best moves in the last analysis
+ *            of the current position, by visits after a search and by
+ *            prior otherwise.
+ *            If the position has not been analyzed since it last
+ *            changed, the list is empty.
  * Arguments: none
  * Fails:   : never
  * Returns  : list of moves with weights
@@ -1543,11 +1696,12 @@ gtp_top_moves(char *s)
   int k;
   UNUSED(s);
   gtp_start_response(GTP_SUCCESS);
-  for (k = 0; k < 10; k++)
-    if (best_move_values[k] > 0.0) {
-      gtp_print_vertex(I(best_moves[k]), J(best_moves[k]));
-      gtp_printf(" %.2f ", best_move_values[k]);
-    }
+  if (current_analysis())
+    for (k = 0; k < 10; k++)
+      if (best_move_values[k] > 0.0) {
+	gtp_print_vertex(I(best_moves[k]), J(best_moves[k]));
+	gtp_printf(" %.2f ", best_move_values[k]);
+      }
   gtp_printf("\n\n");
   return GTP_OK;
 }
@@ -1563,7 +1717,7 @@ gtp_top_moves_white(char *s)
 {
   int k;
   UNUSED(s);
-  genmove(WHITE, NULL, NULL);
+  analyze_position(WHITE, use_monte_carlo_genmove);
   gtp_start_response(GTP_SUCCESS);
   for (k = 0; k < 10; k++)
     if (best_move_values[k] > 0.0) {
@@ -1584,7 +1738,7 @@ gtp_top_moves_black(char *s)
 {
   int k;
   UNUSED(s);
-  genmove(BLACK, NULL, NULL);
+  analyze_position(BLACK, use_monte_carlo_genmove);
   gtp_start_response(GTP_SUCCESS);
   for (k = 0; k < 10; k++)
     if (best_move_values[k] > 0.0) {
@@ -1732,7 +1886,7 @@ finish_and_score_game(int seed)
   int pass = 0;
   int moves = 0;
   int saved_board[MAX_BOARD][MAX_BOARD];
-  struct board_state saved_pos;
+  struct board_snapshot *saved_pos;
   static int current_board[MAX_BOARD][MAX_BOARD];
   static int current_seed = -1;
   int cached_board = 1;
@@ -1756,7 +1910,7 @@ finish_and_score_game(int seed)
     return;
 
   doing_scoring = 1;
-  store_board(&saved_pos);
+  saved_pos = take_board_snapshot();
 
   /* Let black start if we have no move history. Otherwise continue
    * alternation.
@@ -1779,7 +1933,8 @@ finish_and_score_game(int seed)
     next = OTHER_COLOR(next);
   } while (pass < 2 && moves < board_size * board_size);
 
-  restore_board(&saved_pos);
+  restore_board_snapshot(saved_pos);
+  free_board_snapshot(saved_pos);
   doing_scoring = 0;
 
   /* Update the status for vertices which were changed while finishing
@@ -2038,9 +2193,10 @@ has_prefix(const char *s, const char *prefix)
 
 
 
-/* Function:  List probabilities of each move being played (when non-zero).
- *            If no previous genmove command has been issued, the result
- *            of this command will be meaningless.
+/* Function:  List probabilities of each move being played (when non-zero),
+ *            from the last analysis of the current position.
+ *            If the position has not been analyzed since it last
+ *            changed, the list is empty.
  * Arguments: none
  * Fails:     never
  * Returns:   Move, probabilty pairs, one per row.
@@ -2054,7 +2210,7 @@ gtp_move_probabilities(char *s)
 
   UNUSED(s);
 
-  memset(probabilities,0,BOARDMAX);
+  compute_move_probabilities(probabilities);
 
   gtp_start_response(GTP_SUCCESS);
   for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
@@ -2073,9 +2229,10 @@ gtp_move_probabilities(char *s)
 }
 
 
-/* Function:  Return the number of bits of uncertainty in the move.
- *            If no previous genmove command has been issued, the result
- *            of this command will be meaningless.
+/* Function:  Return the number of bits of uncertainty in the move,
+ *            from the last analysis of the current position.
+ *            If the position has not been analyzed since it last
+ *            changed, the uncertainty is zero.
  * Arguments: none
  * Fails:     never
  * Returns:   bits of uncertainty
@@ -2089,7 +2246,7 @@ gtp_move_uncertainty(char *s)
 
   UNUSED(s);
 
-  memset(probabilities,0,BOARDMAX);
+  compute_move_probabilities(probabilities);
 
   gtp_start_response(GTP_SUCCESS);
   for (pos = BOARDMIN; pos < BOARDMAX; pos++) {
@@ -2106,6 +2263,70 @@ gtp_move_uncertainty(char *s)
 }
 
 
+/* Function:  Report the expected owner of each point at the end of the
+ *            game, from the playouts of the last search of the
+ *            current position.
+ * Arguments: none
+ * Fails:     no search of the current position with playouts
+ * Returns:   One row of values per board row, from 1.0 for black
+ *            to -1.0 for white.
+ */
+static int
+gtp_ownership(char *s)
+{
+  const struct position_analysis *a = current_analysis();
+  int i, j;
+
+  UNUSED(s);
+
+  if (!a || !a->searched || a->playouts == 0)
+    return gtp_failure("no ownership available");
+
+  gtp_start_response(GTP_SUCCESS);
+  for (i = 0; i < board_size; i++) {
+    for (j = 0; j < board_size; j++)
+      gtp_printf("%s%6.2f", j > 0 ? " " : "", a->ownership[POS(i, j)]);
+    gtp_printf("\n");
+  }
+
+  return gtp_finish_response();
+}
+
+
+/* Function:  Report the estimated winning probability of the side to
+ *            move in the last analysis of the current position, from
+ *            the search if one was made and otherwise from the value
+ *            head of the network.
+ * Arguments: none
+ * Fails:     no search or network value for the current position
+ * Returns:   Color and winning probability.
+ */
+static int
+gtp_winrate(char *s)
+{
+  const struct position_analysis *a = current_analysis();
+  float win_rate;
+
+  UNUSED(s);
+
+  if (a && a->searched && a->total_visits > 0) {
+    int pos;
+    win_rate = 0.0;
+    for (pos = BOARDMIN; pos < BOARDMAX; pos++)
+      win_rate += a->win_rate[pos] * a->visits[pos];
+    win_rate /= a->total_visits;
+  }
+  else if (a && a->evaluated && nn_have_value_head())
+    win_rate = (a->value + 1.0) / 2.0;
+  else
+    return gtp_failure("no win rate available");
+
+  gtp_start_response(GTP_SUCCESS);
+  gtp_printf("%s %.4f", color_to_string(a->color), win_rate);
+  return gtp_finish_response();
+}
+
+
 
 static SGFTree gtp_sgftree;
 
@@ -0,0 +1,66 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+ * This is GNU Go, a Go program. Contact gnugo@gnu.org, or see       *
+ * http://www.gnu.org/software/gnugo/ for more information.          *
+ *                                                                   *
+ * Copyright 1999, 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2007,   *
+ * 2008, 2009, 2010 and 2011 by the Free Software Foundation.        *
+ *                                                                   *
+ * This program is free software; you can redistribute it and/or     *
+ * modify it under the terms of the GNU General Public License as    *
+ * published by the Free Software Foundation - version 3 or          *
+ * (at your option) any later version.                               *
+ *                                                                   *
+ * This program is distributed in the hope that it will be useful,   *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of    *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the     *
+ * GNU General Public License in file COPYING for more details.      *
+ *                                                                   *
+ * You should have received a copy of the GNU General Public         *
+ * License along with this program; if not, write to the Free        *
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,       *
+ * Boston, MA 02111, USA.                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _GG_THREAD_H_
+#define _GG_THREAD_H_
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/* Minimal threading primitives. Where POSIX threads are not available
+ * the engine runs single threaded and the locks compile to nothing.
+ */
+
+#if HAVE_PTHREAD
+
+#include <pthread.h>
+
+typedef pthread_mutex_t gg_mutex_t;
+
+#define gg_mutex_init(m)    pthread_mutex_init((m), NULL)
+#define gg_mutex_destroy(m) pthread_mutex_destroy(m)
+#define gg_mutex_lock(m)    pthread_mutex_lock(m)
+#define gg_mutex_unlock(m)  pthread_mutex_unlock(m)
+
+#else
+
+typedef int gg_mutex_t;
+
+#define gg_mutex_init(m)    ((void) (m))
+#define gg_mutex_destroy(m) ((void) (m))
+#define gg_mutex_lock(m)    ((void) (m))
+#define gg_mutex_unlock(m)  ((void) (m))
+
+#endif
+
+
+#endif /* _GG_THREAD_H_ */
+
+
+/*
+ * Local Variables:
+ * tab-width: 8
+ * c-basic-offset: 2
+ * End:
+ */